@@ -1,10 +1,14 @@
 require 'thread'
 require 'pp'
 
+# usage: ruby add_legend.rb [width height max_block_height blocks_per_image]
+# width, height, max_block_height and blocks_per_image need to be the same as for BitcoinVisualizer
+# (--resolution, --blocks, --blocks-per-frame)
 offset_x = 13
-resolution_y_pixel = 3840
-resolution_y_blocks = 550000
-blocks_per_image = 30
+resolution_x_pixel = (ARGV[0] || 3840).to_i
+resolution_y_pixel = (ARGV[1] || 2160).to_i
+resolution_x_blocks = (ARGV[2] || 550000).to_i
+blocks_per_image = (ARGV[3] || 30).to_i
 
 input_legend = "legend.pgm"
 input = "img/**.png"
@@ -19,6 +23,7 @@ end
 
 pointsize = 16
 point_offset = 6
+legend_labels = ["100 kBTC", "10 kBTC", "1 kBTC", "100 BTC", "10 BTC", "1 BTC", "100 mBTC", "10 mBTC", "1 mBTC", "100 µBTC", "10 µBTC", "1 µBTC", "1 Finney", "1 Satoshi"]
 
 # fill up queue
 queue = Queue.new
@@ -57,7 +62,7 @@ Dir["img/**.png"].each do |input_filename|
 
 	block_height = basename.to_i * blocks_per_image
 	
-	pos_line = resolution_y_pixel * block_height / resolution_y_blocks
+	pos_line = resolution_x_pixel * block_height / resolution_x_blocks
 	offset_composite_x = pos_line + offset_x
 
 	# composit drawing
@@ -65,23 +70,21 @@ Dir["img/**.png"].each do |input_filename|
 	# set up annotations
 	cmd += " -pointsize #{pointsize} -fill snow3"
 
-	cmd += " -annotate +#{offset_composite_x+16}+#{0+pointsize} \"100 kBTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{166+point_offset} \"10 kBTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{332+point_offset} \"1 kBTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{498+point_offset} \"100 BTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{664+point_offset} \"10 BTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{830+point_offset} \"1 BTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{996+point_offset} \"100 mBTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{1163+point_offset} \"10 mBTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{1329+point_offset} \"1 mBTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{1495+point_offset} \"100 µBTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{1661+point_offset} \"10 µBTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{1827+point_offset} \"1 µBTC\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{1993+point_offset} \"1 Finney\""
-	cmd += " -annotate +#{offset_composite_x+16}+#{2159-2} \"1 Satoshi\""
+	# one label for each power of 10, the legend goes from 100 kBTC at the top down to 1 Satoshi.
+	legend_labels.each_with_index do |label, i|
+		y = (i * (resolution_y_pixel - 1) / (legend_labels.size - 1).to_f).round
+		if i == 0
+			y = pointsize
+		elsif i == legend_labels.size - 1
+			y -= 2
+		else
+			y += point_offset
+		end
+		cmd += " -annotate +#{offset_composite_x+16}+#{y} \"#{label}\""
+	end
 	
 	blk = headers[block_height]
-	off_y = 1900
+	off_y = resolution_y_pixel - 260
 	line_offset = 22
 	off_y -= line_offset
 
@@ -4,6 +4,10 @@
 :: as only few pixels change from frame to frame.
 ::3rdparty\ffmpeg -r 60 -i img_with_legend\%%08d.png -c:v libx264 -preset veryslow -crf 0 utxo_with_legend.mp4
 3rdparty\ffmpeg -r 60 -i img_with_legend\%%08d.png -pix_fmt yuv444p -profile:v high444 -c:v libx264 -preset veryslow -crf 0 utxo_with_legend.mp4
+::
+:: without the legend, the frames can also come directly from BitcoinVisualizer as YUV, then ffmpeg
+:: doesn't have to convert the colors of every frame:
+::bv utxo.bin --y4m --sink - | 3rdparty\ffmpeg -f yuv4mpegpipe -i - -profile:v high444 -c:v libx264 -preset veryslow -crf 0 utxo.mp4
 
 
 pause
\ No newline at end of file
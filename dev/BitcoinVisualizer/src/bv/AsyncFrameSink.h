@@ -0,0 +1,130 @@
+#pragma once
+
+#include <bv/FrameWriter.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace bv {
+
+// Writes frames with a FrameWriter on a dedicated thread, so the next block can be integrated
+// while the previous frame is still being transmitted.
+//
+// The frames live in a ring of num_buffers pre-allocated buffers. The producer fills the buffer it
+// gets from acquire() and hands it over with submit(); the writer thread sends the submitted
+// buffers in order. When all buffers are in flight because the receiver (e.g. ffmpeg) can't keep
+// up, acquire() blocks until the oldest frame has been written.
+class AsyncFrameSink
+{
+public:
+    AsyncFrameSink(std::unique_ptr<FrameWriter> writer, size_t frame_size, size_t num_buffers)
+        : m_writer(std::move(writer)),
+          m_buffers(num_buffers < 1 ? 1 : num_buffers),
+          m_is_ok(true),
+          m_thread([this] { write_loop(); })
+    {
+        for (auto& frame : m_buffers) {
+            frame.rgb.resize(frame_size);
+        }
+    }
+
+    // writes all frames that are still queued
+    ~AsyncFrameSink()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_is_done = true;
+        }
+        m_cv_writer.notify_one();
+        m_thread.join();
+    }
+
+    // Buffer for the next frame, with frame_size bytes of RGB. Waits while all buffers are queued.
+    // The buffers are handed out in ring order, and keep their content from the last time they
+    // were used.
+    Frame& acquire()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv_producer.wait(lock, [&] { return m_num_queued < m_buffers.size(); });
+        return m_buffers[m_fill_idx];
+    }
+
+    // queues the buffer from acquire() for writing.
+    void submit()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_fill_idx = (m_fill_idx + 1) % m_buffers.size();
+            ++m_num_queued;
+        }
+        m_cv_writer.notify_one();
+    }
+
+    // Waits until all queued frames are written. Returns false if any frame could not be written.
+    bool flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv_producer.wait(lock, [&] { return m_num_queued == 0; });
+        return m_is_ok;
+    }
+
+    size_t num_buffers() const
+    {
+        return m_buffers.size();
+    }
+
+    // false as soon as a write has failed. Once broken, all further frames are dropped.
+    bool is_ok() const
+    {
+        return m_is_ok;
+    }
+
+private:
+    void write_loop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_cv_writer.wait(lock, [&] { return m_num_queued != 0 || m_is_done; });
+            if (m_num_queued == 0) {
+                // done, and everything written
+                return;
+            }
+
+            // the buffer stays queued while it is written, so acquire() can't hand it out.
+            auto const& frame = m_buffers[m_write_idx];
+            lock.unlock();
+            if (m_is_ok) {
+                m_is_ok = m_writer->write(frame);
+            }
+            lock.lock();
+
+            m_write_idx = (m_write_idx + 1) % m_buffers.size();
+            --m_num_queued;
+            m_cv_producer.notify_one();
+        }
+    }
+
+    std::unique_ptr<FrameWriter> const m_writer;
+    std::vector<Frame> m_buffers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv_writer;
+    std::condition_variable m_cv_producer;
+    size_t m_fill_idx = 0;
+    size_t m_write_idx = 0;
+    size_t m_num_queued = 0;
+    bool m_is_done = false;
+    std::atomic<bool> m_is_ok;
+
+    // last member, so everything above is initialized before the thread starts.
+    std::thread m_thread;
+};
+
+} // namespace bv
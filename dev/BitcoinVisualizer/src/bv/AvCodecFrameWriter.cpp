@@ -0,0 +1,173 @@
+#include <bv/AvCodecFrameWriter.h>
+
+#ifdef BV_WITH_LIBAVCODEC
+#include <bv/Yuv444.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/dict.h>
+#include <libavutil/frame.h>
+}
+#endif
+
+namespace bv {
+
+#ifdef BV_WITH_LIBAVCODEC
+
+class AvCodecFrameWriterImpl final : public AvCodecFrameWriter
+{
+public:
+    // flushes the encoder and finishes the file
+    ~AvCodecFrameWriterImpl()
+    {
+        if (m_is_header_written) {
+            if (m_is_ok) {
+                encode(nullptr);
+            }
+            av_write_trailer(m_format);
+        }
+        if (m_format && !(m_format->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&m_format->pb);
+        }
+        av_packet_free(&m_packet);
+        av_frame_free(&m_frame);
+        avcodec_free_context(&m_codec);
+        avformat_free_context(m_format);
+    }
+
+    bool open(std::string const& filename, size_t width, size_t height, Options const& options)
+    {
+        if (avformat_alloc_output_context2(&m_format, nullptr, nullptr, filename.c_str()) < 0) {
+            return false;
+        }
+        auto const* codec = avcodec_find_encoder_by_name(options.codec.c_str());
+        if (!codec) {
+            return false;
+        }
+        m_stream = avformat_new_stream(m_format, nullptr);
+        m_codec = avcodec_alloc_context3(codec);
+        if (!m_stream || !m_codec) {
+            return false;
+        }
+
+        m_codec->width = static_cast<int>(width);
+        m_codec->height = static_cast<int>(height);
+        m_codec->time_base = AVRational{1, static_cast<int>(options.frame_rate)};
+        m_codec->framerate = AVRational{static_cast<int>(options.frame_rate), 1};
+        m_codec->pix_fmt = AV_PIX_FMT_YUV444P;
+        m_codec->color_range = AVCOL_RANGE_MPEG;
+        m_codec->colorspace = AVCOL_SPC_SMPTE170M;
+        m_codec->color_primaries = AVCOL_PRI_SMPTE170M;
+        m_codec->color_trc = AVCOL_TRC_SMPTE170M;
+        m_codec->thread_count = options.num_threads;
+        if (m_format->oformat->flags & AVFMT_GLOBALHEADER) {
+            m_codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+
+        // private options of the encoder. Options the encoder doesn't know are left in the dictionary.
+        AVDictionary* codec_options = nullptr;
+        if (options.crf >= 0) {
+            av_dict_set_int(&codec_options, "crf", options.crf, 0);
+        }
+        auto const ret = avcodec_open2(m_codec, codec, &codec_options);
+        av_dict_free(&codec_options);
+        if (ret < 0 || avcodec_parameters_from_context(m_stream->codecpar, m_codec) < 0) {
+            return false;
+        }
+        m_stream->time_base = m_codec->time_base;
+
+        if (!(m_format->oformat->flags & AVFMT_NOFILE) && avio_open(&m_format->pb, filename.c_str(), AVIO_FLAG_WRITE) < 0) {
+            return false;
+        }
+        if (avformat_write_header(m_format, nullptr) < 0) {
+            return false;
+        }
+        m_is_header_written = true;
+
+        m_frame = av_frame_alloc();
+        m_packet = av_packet_alloc();
+        if (!m_frame || !m_packet) {
+            return false;
+        }
+        m_frame->format = m_codec->pix_fmt;
+        m_frame->width = m_codec->width;
+        m_frame->height = m_codec->height;
+        m_frame->color_range = m_codec->color_range;
+        m_frame->colorspace = m_codec->colorspace;
+        return av_frame_get_buffer(m_frame, 0) >= 0;
+    }
+
+    // The YUV planes are kept in m_frame from frame to frame, so only the changed pixels have to
+    // be converted. If the encoder still holds a reference to the planes, av_frame_make_writable()
+    // copies them first.
+    bool write(Frame const& frame) override
+    {
+        if (!m_is_ok || av_frame_make_writable(m_frame) < 0) {
+            m_is_ok = false;
+            return false;
+        }
+        uint8_t* const planes[3] = {m_frame->data[0], m_frame->data[1], m_frame->data[2]};
+        size_t const linesizes[3] = {static_cast<size_t>(m_frame->linesize[0]), static_cast<size_t>(m_frame->linesize[1]),
+                                     static_cast<size_t>(m_frame->linesize[2])};
+        Yuv444::update(frame, static_cast<size_t>(m_frame->width), static_cast<size_t>(m_frame->height), planes, linesizes);
+
+        m_frame->pts = m_next_pts++;
+        m_is_ok = encode(m_frame);
+        return m_is_ok;
+    }
+
+private:
+    // Sends the frame to the encoder (nullptr flushes it), and writes all packets it has ready.
+    bool encode(AVFrame const* frame)
+    {
+        if (avcodec_send_frame(m_codec, frame) < 0) {
+            return false;
+        }
+        while (true) {
+            auto const ret = avcodec_receive_packet(m_codec, m_packet);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return true;
+            }
+            if (ret < 0) {
+                return false;
+            }
+            av_packet_rescale_ts(m_packet, m_codec->time_base, m_stream->time_base);
+            m_packet->stream_index = m_stream->index;
+
+            // takes over the packet's data and resets it
+            if (av_interleaved_write_frame(m_format, m_packet) < 0) {
+                return false;
+            }
+        }
+    }
+
+    AVFormatContext* m_format = nullptr;
+    AVStream* m_stream = nullptr;
+    AVCodecContext* m_codec = nullptr;
+    AVFrame* m_frame = nullptr;
+    AVPacket* m_packet = nullptr;
+    int64_t m_next_pts = 0;
+    bool m_is_header_written = false;
+    bool m_is_ok = true;
+};
+
+std::unique_ptr<AvCodecFrameWriter> AvCodecFrameWriter::open(std::string const& filename, size_t width, size_t height, Options const& options)
+{
+    auto writer = std::make_unique<AvCodecFrameWriterImpl>();
+    if (!writer->open(filename, width, height, options)) {
+        return nullptr;
+    }
+    return writer;
+}
+
+#else
+
+std::unique_ptr<AvCodecFrameWriter> AvCodecFrameWriter::open(std::string const&, size_t, size_t, Options const&)
+{
+    return nullptr;
+}
+
+#endif
+
+} // namespace bv
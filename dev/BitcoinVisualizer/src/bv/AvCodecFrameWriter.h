@@ -0,0 +1,42 @@
+#pragma once
+
+#include <bv/FrameWriter.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace bv {
+
+// Encodes the frames in this process with libavcodec, and muxes them into a video file with
+// libavformat (the container is picked from the extension, e.g. .mkv or .mp4). No frames have to
+// go through a socket to a separate ffmpeg, so a whole render is a single job.
+//
+// The frames are encoded as YUV 4:4:4 (see Yuv444), which libx264, libx265 and ffv1 all support.
+// Only available when built with BV_WITH_LIBAVCODEC and linked with avformat, avcodec and avutil.
+//
+// abstract class so the libav headers stay in the .cpp file.
+class AvCodecFrameWriter : public FrameWriter
+{
+public:
+    struct Options {
+        // name of the encoder, e.g. libx264, libx265 or ffv1
+        std::string codec = "libx264";
+
+        // constant rate factor, 0 is lossless with libx264. < 0 uses the default of the encoder.
+        // Encoders without CRF (e.g. ffv1) ignore it, as they are lossless anyway.
+        int crf = 0;
+
+        // number of encoding threads, 0 lets the encoder decide
+        int num_threads = 0;
+
+        uint32_t frame_rate = 60;
+    };
+
+    // factory. Returns nullptr if the encoder or the file can't be opened, or if this build has
+    // no libavcodec. libav prints the reason to stderr.
+    static std::unique_ptr<AvCodecFrameWriter> open(std::string const& filename, size_t width, size_t height, Options const& options);
+};
+
+} // namespace bv
@@ -1,25 +1,85 @@
 #pragma once
 
+#include <bv/BlkIndex.h>
 #include <bv/BufferedStreamReader.h>
+#include <bv/BulkVarInt.h>
+#include <bv/MemoryMappedFile.h>
+#include <bv/MemoryStreamReader.h>
+#include <bv/PixelDelta.h>
+#include <bv/VarInt.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace bv {
 
 // Decodes a .blk file, and calls the given callbacks for each event.
-// Returns false if a parsing error is detected.
+// Returns false if a parsing error is detected. All decoders set last_block_height (if given) to
+// the height of the last decoded block, or to 0 when no block was decoded.
 class Blk
 {
 public:
+    // Memory maps the file so decoding runs directly on the mapped pages. Falls back to buffered
+    // reading if the file can't be mapped.
     template <class T>
     static bool decode(std::string filename, T& callback, uint32_t* last_block_height)
     {
-        std::ifstream fin(filename, std::ios::binary);
-        if (!fin.is_open()) {
+        auto mapped_file = MemoryMappedFile::open(filename);
+        if (mapped_file) {
+            MemoryStreamReader msr(mapped_file->data(), mapped_file->data() + mapped_file->size());
+            return decode_stream(msr, callback, last_block_height);
+        }
+        return decode_buffered(filename, 0, std::numeric_limits<uint32_t>::max(), callback, last_block_height);
+    }
+
+    // Decodes only the blocks in [from_block_height, to_block_height]. Uses the sidecar index
+    // (see BlkIndex) to jump directly to the first block; the index is built and saved next to
+    // the .blk file if it doesn't exist yet or is outdated (if it can't be saved, it is built
+    // again next time). If the file can't be mapped, the whole file is read buffered instead.
+    template <class T>
+    static bool decode_range(std::string filename, uint32_t from_block_height, uint32_t to_block_height, T& callback, uint32_t* last_block_height)
+    {
+        auto mapped_file = MemoryMappedFile::open(filename);
+        if (!mapped_file) {
+            return decode_buffered(filename, from_block_height, to_block_height, callback, last_block_height);
+        }
+        auto const* begin = mapped_file->data();
+
+        BlkIndex index;
+        if (!load_or_build_index(filename, *mapped_file, index)) {
             return false;
         }
+        auto const first = index.lower_bound(from_block_height);
+        auto const last = index.upper_bound(to_block_height);
+        if (first == last) {
+            // nothing to decode
+            if (last_block_height) {
+                *last_block_height = 0;
+            }
+            return true;
+        }
 
-        BufferedStreamReader<> bsr(fin);
+        auto const& last_entry = *(last - 1);
+        MemoryStreamReader msr(begin + first->offset, begin + last_entry.offset + last_entry.num_bytes);
+        return decode_stream(msr, callback, last_block_height);
+    }
 
-        uint32_t current_block_height;
+    // Decodes from any reader that provides read(), read1() and eof(), like BufferedStreamReader
+    // or MemoryStreamReader.
+    template <class S, class T>
+    static bool decode_stream(S& bsr, T& callback, uint32_t* last_block_height)
+    {
+        if (last_block_height) {
+            *last_block_height = 0;
+        }
+        uint32_t current_block_height = 0;
         while (true) {
             uint32_t magick_BLK0;
             bsr.read(magick_BLK0);
@@ -40,62 +100,283 @@ public:
 
             uint32_t num_bytes_total;
             bsr.read(num_bytes_total);
+            if (!decode_changes(bsr, num_bytes_total, callback)) {
+                return false;
+            }
+
+            callback.end_block(current_block_height);
+        }
+
+        return true;
+    }
 
-            int64_t amount;
-            uint32_t amount_block_height;
+    // Decodes the blocks in [from_block_height, to_block_height] with multiple threads. The
+    // records are located with the index (see BlkIndex), worker threads decode them ahead of
+    // time into aggregated PixelDelta batches, and the calling thread applies the batches
+    // strictly in block order. The callback needs:
+    //
+    //   uint32_t pixel_idx(uint32_t block_height, int64_t amount) const; // called concurrently by the workers!
+    //   void begin_block(uint32_t block_height);
+    //   void apply(PixelDelta const* pixel_deltas, size_t count);
+    //   void end_block(uint32_t block_height);
+    template <class T>
+    static bool decode_parallel(std::string filename, uint32_t from_block_height, uint32_t to_block_height, T& callback, size_t num_threads, uint32_t* last_block_height)
+    {
+        // the workers need the mapped file, without it this is the same as single threaded.
+        auto mapped_file = MemoryMappedFile::open(filename);
+        if (!mapped_file) {
+            return decode_buffered(filename, from_block_height, to_block_height, callback, last_block_height);
+        }
+        auto const* begin = mapped_file->data();
+
+        BlkIndex index;
+        if (!load_or_build_index(filename, *mapped_file, index)) {
+            return false;
+        }
+        auto const first = index.lower_bound(from_block_height);
+        auto const last = index.upper_bound(to_block_height);
+        size_t const num_records = static_cast<size_t>(last - first);
 
-            // read first dataset: not varint encoded
-            bsr.read(amount);
-            bsr.read(amount_block_height);
-            callback.change(amount_block_height, amount, false);
+        // Each record in flight has a slot. Record i can only be decoded once record i - num_slots
+        // has been applied, so memory stays bounded even when the consumer is slow.
+        struct Slot {
+            std::vector<PixelDelta> pixel_deltas;
+            bool is_ready = false;
+        };
+        std::vector<Slot> slots(4 * num_threads);
 
-            size_t bytes_read = sizeof(amount) + sizeof(amount_block_height);
+        std::mutex mutex;
+        std::condition_variable cv_worker;
+        std::condition_variable cv_consumer;
+        size_t next_to_decode = 0;
+        size_t next_to_apply = 0;
+        bool is_ok = true;
 
-            while (bytes_read < num_bytes_total) {
-                uint64_t amount_diff;
-                bytes_read += decode_uint(bsr, amount_diff);
-                amount += amount_diff;
+        auto worker = [&]() {
+            while (true) {
+                size_t record_idx;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv_worker.wait(lock, [&] {
+                        return next_to_decode == num_records || next_to_decode < next_to_apply + slots.size();
+                    });
+                    if (next_to_decode == num_records) {
+                        return;
+                    }
+                    record_idx = next_to_decode++;
+                }
+
+                auto const& e = first[record_idx];
+                auto& slot = slots[record_idx % slots.size()];
+                slot.pixel_deltas.clear();
+                MemoryStreamReader msr(begin + e.offset + BlkIndex::header_size, begin + e.offset + e.num_bytes);
+                PixelDeltaCollector<T> collector{callback, slot.pixel_deltas};
+                auto const is_record_ok = decode_changes(msr, e.num_bytes - BlkIndex::header_size, collector);
+                aggregate(slot.pixel_deltas);
 
-                int32_t block_height_diff;
-                bytes_read += decode_int32(bsr, block_height_diff);
-                amount_block_height += block_height_diff;
-                callback.change(amount_block_height, amount, amount_diff == 0 && block_height_diff == 0);
-                //callback.change(amount_block_height, amount, false);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    slot.is_ready = true;
+                    is_ok = is_ok && is_record_ok;
+                }
+                cv_consumer.notify_one();
             }
+        };
 
-            callback.end_block(current_block_height);
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers.emplace_back(worker);
         }
 
-        return true;
+        for (size_t record_idx = 0; record_idx < num_records; ++record_idx) {
+            auto& slot = slots[record_idx % slots.size()];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv_consumer.wait(lock, [&] { return slot.is_ready; });
+            }
+
+            auto const block_height = first[record_idx].block_height;
+            callback.begin_block(block_height);
+            callback.apply(slot.pixel_deltas.data(), slot.pixel_deltas.size());
+            callback.end_block(block_height);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slot.is_ready = false;
+                ++next_to_apply;
+            }
+            cv_worker.notify_all();
+        }
+
+        for (auto& w : workers) {
+            w.join();
+        }
+
+        if (last_block_height) {
+            *last_block_height = num_records != 0 ? (last - 1)->block_height : 0;
+        }
+        return is_ok;
     }
 
 private:
-    template <typename S, typename T>
-    static size_t decode_uint(S& is, T& val)
+    // Reads the whole file with a BufferedStreamReader, and only forwards the blocks in
+    // [from_block_height, to_block_height]. For files that can't be memory mapped.
+    template <class T>
+    static bool decode_buffered(std::string const& filename, uint32_t from_block_height, uint32_t to_block_height, T& callback, uint32_t* last_block_height)
     {
-        static_assert(std::is_unsigned<T>::value, "only for unsigned types");
-
-        int num_bytes = 0;
-        val = 0;
-        uint8_t byte;
-        is.read1(byte);
-        while (byte & 0b10000000) {
-            val |= static_cast<T>(byte & 0b01111111) << (7 * num_bytes);
-            ++num_bytes;
-            is.read1(byte);
-        }
-        val |= static_cast<T>(byte) << (7 * num_bytes);
-        return num_bytes + 1;
+        if (last_block_height) {
+            *last_block_height = 0;
+        }
+        std::ifstream fin(filename, std::ios::binary);
+        if (!fin.is_open()) {
+            return false;
+        }
+
+        BufferedStreamReader<> bsr(fin);
+        RangeFilter<T> range_filter{callback, from_block_height, to_block_height};
+        auto const is_ok = decode_stream(bsr, range_filter, nullptr);
+        if (last_block_height) {
+            *last_block_height = range_filter.m_last_block_height;
+        }
+        return is_ok;
     }
 
-    template <typename S>
-    static size_t decode_int32(S& is, int32_t& val)
+    // forwards only the blocks in [m_from_block_height, m_to_block_height], see decode_buffered.
+    template <class T>
+    struct RangeFilter {
+        void begin_block(uint32_t block_height)
+        {
+            m_is_in_range = block_height >= m_from_block_height && block_height <= m_to_block_height;
+            if (m_is_in_range) {
+                m_callback.begin_block(block_height);
+            }
+        }
+
+        void change(uint32_t block_height, int64_t amount, bool is_same_as_previous_change)
+        {
+            if (m_is_in_range) {
+                m_callback.change(block_height, amount, is_same_as_previous_change);
+            }
+        }
+
+        void end_block(uint32_t block_height)
+        {
+            if (m_is_in_range) {
+                m_callback.end_block(block_height);
+                m_last_block_height = block_height;
+            }
+        }
+
+        T& m_callback;
+        uint32_t const m_from_block_height;
+        uint32_t const m_to_block_height;
+        bool m_is_in_range = false;
+        uint32_t m_last_block_height = 0;
+    };
+
+    // Loads the index that belongs to the mapped .blk file, or builds it if it doesn't exist yet
+    // or is outdated.
+    static bool load_or_build_index(std::string const& filename, MemoryMappedFile const& mapped_file, BlkIndex& index)
     {
-        uint32_t v;
-        auto num_bytes = decode_uint(is, v);
-        val = static_cast<int32_t>((v >> 1) ^ (uint32_t)0 - (v & 1));
-        return num_bytes;
+        auto const index_filename = BlkIndex::filename_for(filename);
+        if (index.load(index_filename, mapped_file.size())) {
+            return true;
+        }
+        if (!index.build(mapped_file.data(), mapped_file.data() + mapped_file.size())) {
+            return false;
+        }
+        // not being able to save the index is not an error, it's just slower next time.
+        index.save(index_filename);
+        return true;
     }
+
+    // Decodes the changes of one record, num_bytes_total is the size of the record's payload.
+    // Returns false if the payload can't even hold the first change.
+    template <class S, class T>
+    static bool decode_changes(S& bsr, uint32_t num_bytes_total, T& callback)
+    {
+        int64_t amount;
+        uint32_t amount_block_height;
+        if (num_bytes_total < sizeof(amount) + sizeof(amount_block_height)) {
+            return false;
+        }
+
+        // read first dataset: not varint encoded
+        bsr.read(amount);
+        bsr.read(amount_block_height);
+        callback.change(amount_block_height, amount, false);
+
+        size_t bytes_read = sizeof(amount) + sizeof(amount_block_height);
+
+        while (bytes_read < num_bytes_total) {
+            uint64_t amount_diff;
+            bytes_read += VarInt::decode_uint(bsr, amount_diff);
+            amount += amount_diff;
+
+            int32_t block_height_diff;
+            bytes_read += VarInt::decode_int32(bsr, block_height_diff);
+            amount_block_height += block_height_diff;
+            callback.change(amount_block_height, amount, amount_diff == 0 && block_height_diff == 0);
+            //callback.change(amount_block_height, amount, false);
+        }
+        return true;
+    }
+
+    // Same as above, but when the data is already in memory we can decode the whole payload at
+    // once with BulkVarInt instead of byte by byte. Also returns false if the payload goes beyond
+    // the end of the data or ends within a change, after decoding the complete changes.
+    template <class T>
+    static bool decode_changes(MemoryStreamReader& msr, uint32_t num_bytes_total, T& callback)
+    {
+        int64_t amount;
+        uint32_t amount_block_height;
+        size_t const first_change_size = sizeof(amount) + sizeof(amount_block_height);
+
+        uint8_t const* record = msr.pos();
+        msr.skip(num_bytes_total);
+        auto const num_bytes = static_cast<size_t>(msr.pos() - record);
+        if (num_bytes_total < first_change_size || num_bytes < first_change_size) {
+            return false;
+        }
+
+        // read first dataset: not varint encoded
+        std::memcpy(&amount, record, sizeof(amount));
+        std::memcpy(&amount_block_height, record + sizeof(amount), sizeof(amount_block_height));
+        callback.change(amount_block_height, amount, false);
+
+        // reused for all records so we don't allocate for each block. Each pair takes at least 2 bytes.
+        uint8_t const* payload = record + first_change_size;
+        auto const num_varint_bytes = num_bytes - first_change_size;
+        thread_local std::vector<uint64_t> amount_diffs;
+        thread_local std::vector<int32_t> block_height_diffs;
+        if (amount_diffs.size() < num_varint_bytes / 2) {
+            amount_diffs.resize(num_varint_bytes / 2);
+            block_height_diffs.resize(num_varint_bytes / 2);
+        }
+
+        uint8_t const* decoded_end = nullptr;
+        auto const num_changes = BulkVarInt::decode_pairs(payload, msr.pos(), amount_diffs.data(), block_height_diffs.data(), &decoded_end);
+        for (size_t i = 0; i < num_changes; ++i) {
+            auto const amount_diff = amount_diffs[i];
+            auto const block_height_diff = block_height_diffs[i];
+            amount += amount_diff;
+            amount_block_height += block_height_diff;
+            callback.change(amount_block_height, amount, amount_diff == 0 && block_height_diff == 0);
+        }
+        return num_bytes == num_bytes_total && decoded_end == msr.pos();
+    }
+
+    // maps each change to its pixel, used by the workers of decode_parallel.
+    template <class T>
+    struct PixelDeltaCollector {
+        void change(uint32_t block_height, int64_t amount, bool)
+        {
+            m_pixel_deltas.push_back({m_mapper.pixel_idx(block_height, amount), amount >= 0 ? 1 : -1});
+        }
+
+        T const& m_mapper;
+        std::vector<PixelDelta>& m_pixel_deltas;
+    };
 };
 
 
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace bv {
+
+// Sidecar index for a .blk file: where each block's record starts, how large it is, and how many
+// changes it contains. With it we can jump straight to any block height instead of decoding the
+// whole history before it. Built in one pass over the records, without decoding the varints.
+//
+// File format (little endian):
+//   "BLKI", uint32_t version, uint64_t size of the indexed .blk file, uint64_t number of entries,
+//   followed by the entries, each: uint32_t block_height, uint32_t num_bytes, uint32_t num_changes, uint64_t offset
+class BlkIndex
+{
+public:
+    struct Entry {
+        uint32_t block_height;
+
+        // size of the whole record, including the "BLK\0" magic, block height and size fields.
+        uint32_t num_bytes;
+        uint32_t num_changes;
+
+        // position of the "BLK\0" magic in the .blk file
+        uint64_t offset;
+    };
+
+    // size of "BLK\0", block height and num_bytes_total in front of each record's payload.
+    static size_t const header_size = 12;
+
+    // the index file that belongs to a .blk file
+    static std::string filename_for(std::string const& blk_filename)
+    {
+        return blk_filename + ".idx";
+    }
+
+    // Walks all records of an in-memory .blk file. Returns false if the data is not a valid
+    // sequence of records.
+    bool build(uint8_t const* begin, uint8_t const* end)
+    {
+        m_entries.clear();
+        m_blk_file_size = static_cast<uint64_t>(end - begin);
+
+        uint8_t const* pos = begin;
+        while (pos != end) {
+            if (static_cast<size_t>(end - pos) < header_size + 12) {
+                return false;
+            }
+
+            // "BLK\0"
+            if (0 != std::memcmp(pos, "BLK\0", 4)) {
+                return false;
+            }
+
+            Entry e;
+            std::memcpy(&e.block_height, pos + 4, sizeof(e.block_height));
+            uint32_t num_bytes_total;
+            std::memcpy(&num_bytes_total, pos + 8, sizeof(num_bytes_total));
+            if (num_bytes_total < 12 || static_cast<size_t>(end - pos) - header_size < num_bytes_total) {
+                return false;
+            }
+            e.num_bytes = static_cast<uint32_t>(header_size + num_bytes_total);
+            e.offset = static_cast<uint64_t>(pos - begin);
+
+            // first change is not varint encoded, each following change consists of exactly two
+            // varints. Every varint ends with a byte that has the high bit cleared.
+            uint8_t const* payload = pos + header_size + 12;
+            uint8_t const* payload_end = pos + header_size + num_bytes_total;
+            size_t num_varints = 0;
+            while (payload != payload_end) {
+                num_varints += (*payload++ & 0b10000000) ? 0 : 1;
+            }
+            e.num_changes = static_cast<uint32_t>(1 + num_varints / 2);
+
+            m_entries.push_back(e);
+            pos = payload_end;
+        }
+        return true;
+    }
+
+    bool save(std::string const& filename) const
+    {
+        std::ofstream fout(filename, std::ios::binary);
+        if (!fout.is_open()) {
+            return false;
+        }
+        fout.write("BLKI", 4);
+        write(fout, static_cast<uint32_t>(version));
+        write(fout, m_blk_file_size);
+        write(fout, static_cast<uint64_t>(m_entries.size()));
+        for (auto const& e : m_entries) {
+            write(fout, e.block_height);
+            write(fout, e.num_bytes);
+            write(fout, e.num_changes);
+            write(fout, e.offset);
+        }
+        return fout.good();
+    }
+
+    // Loads an index file. Fails if it doesn't exist, is broken, or was built for a .blk file
+    // of a different size (e.g. when more blocks were appended since).
+    bool load(std::string const& filename, uint64_t blk_file_size)
+    {
+        std::ifstream fin(filename, std::ios::binary);
+        if (!fin.is_open()) {
+            return false;
+        }
+
+        char magic[4];
+        uint32_t file_version;
+        uint64_t num_entries;
+        fin.read(magic, 4);
+        read(fin, file_version);
+        read(fin, m_blk_file_size);
+        read(fin, num_entries);
+        if (!fin || 0 != std::memcmp(magic, "BLKI", 4) || file_version != version || m_blk_file_size != blk_file_size) {
+            return false;
+        }
+
+        m_entries.resize(static_cast<size_t>(num_entries));
+        for (auto& e : m_entries) {
+            read(fin, e.block_height);
+            read(fin, e.num_bytes);
+            read(fin, e.num_changes);
+            read(fin, e.offset);
+        }
+        return fin.good();
+    }
+
+    // First entry with block_height >= the given height. Records are stored in increasing block
+    // height order, so this is a binary search.
+    std::vector<Entry>::const_iterator lower_bound(uint32_t block_height) const
+    {
+        return std::lower_bound(m_entries.begin(), m_entries.end(), block_height, [](Entry const& e, uint32_t h) {
+            return e.block_height < h;
+        });
+    }
+
+    // First entry with block_height > the given height.
+    std::vector<Entry>::const_iterator upper_bound(uint32_t block_height) const
+    {
+        return std::upper_bound(m_entries.begin(), m_entries.end(), block_height, [](uint32_t h, Entry const& e) {
+            return h < e.block_height;
+        });
+    }
+
+    std::vector<Entry>::const_iterator begin() const
+    {
+        return m_entries.begin();
+    }
+    std::vector<Entry>::const_iterator end() const
+    {
+        return m_entries.end();
+    }
+
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+
+private:
+    static uint32_t const version = 1;
+
+    template <typename T>
+    static void write(std::ofstream& fout, T const& val)
+    {
+        fout.write(reinterpret_cast<char const*>(&val), sizeof(T));
+    }
+
+    template <typename T>
+    static void read(std::ifstream& fin, T& val)
+    {
+        fin.read(reinterpret_cast<char*>(&val), sizeof(T));
+    }
+
+    uint64_t m_blk_file_size = 0;
+    std::vector<Entry> m_entries;
+};
+
+} // namespace bv
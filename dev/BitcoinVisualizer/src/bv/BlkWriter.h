@@ -0,0 +1,125 @@
+#pragma once
+
+#include <bv/Change.h>
+#include <bv/VarInt.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace bv {
+
+// Writes .blk files that Blk can decode, byte for byte the same as ChangeSerializer in the Ruby
+// UtxoFetcher.
+//
+// Each block is a record: "BLK\0", uint32_t block height, uint32_t payload size, then the payload.
+// The payload holds the block's changes sorted by amount, then by block height. The first change is
+// stored as int64_t amount and uint32_t block height. All following ones are stored as the
+// difference to the one before: the amount as a varint (never negative, thanks to the sorting) and
+// the block height as a zigzag varint.
+//
+// The records are collected in a buffer and written in large chunks, so the file isn't touched
+// for every block.
+class BlkWriter
+{
+public:
+    // Truncates the file, or appends to it if is_append is set.
+    BlkWriter(std::string const& filename, bool is_append = false, size_t buffer_size = 1024 * 1024)
+        : m_fout(filename, std::ios::binary | (is_append ? std::ios::app : std::ios::trunc)),
+          m_buffer_size(buffer_size),
+          m_block_height(0)
+    {
+        m_buffer.reserve(buffer_size);
+    }
+
+    ~BlkWriter()
+    {
+        flush();
+    }
+
+    bool is_open() const
+    {
+        return m_fout.is_open();
+    }
+
+    void begin_block(uint32_t block_height)
+    {
+        m_block_height = block_height;
+        m_changes.clear();
+    }
+
+    // an output of amount satoshi from the block with block_height was added (amount >= 0) or
+    // removed (amount < 0).
+    void add(uint32_t block_height, int64_t amount)
+    {
+        m_changes.push_back({block_height, amount});
+    }
+
+    // Encodes the block into the buffer. The format needs at least one change per record, so a
+    // block without changes is not written at all. Returns false if writing failed.
+    bool end_block()
+    {
+        if (m_changes.empty()) {
+            return m_fout.good();
+        }
+
+        std::sort(m_changes.begin(), m_changes.end(), is_before_in_record);
+
+        append(m_buffer, blk_magic);
+        append(m_buffer, m_block_height);
+        auto const size_pos = m_buffer.size();
+        append(m_buffer, uint32_t(0));
+        auto const payload_pos = m_buffer.size();
+
+        auto const& first = m_changes.front();
+        append(m_buffer, first.amount);
+        append(m_buffer, first.block_height);
+        for (size_t i = 1; i < m_changes.size(); ++i) {
+            auto const& previous = m_changes[i - 1];
+            auto const& current = m_changes[i];
+            VarInt::encode_uint(m_buffer, static_cast<uint64_t>(current.amount - previous.amount));
+            VarInt::encode_int32(m_buffer, static_cast<int32_t>(current.block_height - previous.block_height));
+        }
+
+        auto const payload_size = static_cast<uint32_t>(m_buffer.size() - payload_pos);
+        std::copy_n(reinterpret_cast<uint8_t const*>(&payload_size), sizeof(payload_size), m_buffer.begin() + size_pos);
+        m_changes.clear();
+
+        if (m_buffer.size() >= m_buffer_size) {
+            return flush();
+        }
+        return m_fout.good();
+    }
+
+    // Writes all buffered records into the file. Returns false if writing failed.
+    bool flush()
+    {
+        if (!m_buffer.empty()) {
+            m_fout.write(reinterpret_cast<char const*>(m_buffer.data()), m_buffer.size());
+            m_buffer.clear();
+        }
+        m_fout.flush();
+        return m_fout.good();
+    }
+
+private:
+    // "BLK\0"
+    static uint32_t const blk_magic = 0x004b4c42;
+
+    template <typename T>
+    static void append(std::vector<uint8_t>& buf, T val)
+    {
+        auto const* p = reinterpret_cast<uint8_t const*>(&val);
+        buf.insert(buf.end(), p, p + sizeof(T));
+    }
+
+    std::ofstream m_fout;
+    size_t const m_buffer_size;
+    std::vector<uint8_t> m_buffer;
+    uint32_t m_block_height;
+    std::vector<Change> m_changes;
+};
+
+} // namespace bv
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <bv/MemoryStreamReader.h>
+#include <bv/VarInt.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__BMI2__) && !defined(BV_BULKVARINT_NO_PEXT)
+#define BV_BULKVARINT_PEXT
+#endif
+
+#if defined(__AVX2__) || defined(BV_BULKVARINT_PEXT)
+#include <immintrin.h>
+#endif
+#if defined(__AVX2__)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BV_BULKVARINT_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace bv {
+
+// Decodes a whole record payload of (amount diff, zigzag block height diff) varint pairs in one
+// go, instead of one byte at a time through read1().
+//
+// A SIMD compare over a window of 32 bytes (one AVX2 or two SSE2 loads) gives a bitmask of all the
+// bytes that terminate a varint. The length of each varint is then a single count trailing zeros,
+// and its value is extracted from one unaligned 8 byte load without any data dependent loop. With
+// BMI2 the extraction is a single pext. Define BV_BULKVARINT_NO_PEXT for CPUs where pext is
+// microcoded (AMD before Zen 3). Near the end of the payload, and on platforms without SSE2, the
+// scalar VarInt decoder is used.
+class BulkVarInt
+{
+public:
+    // Decodes all complete pairs in [begin, end). Each of them takes at least 2 bytes, so the
+    // output arrays need room for (end - begin) / 2 entries. Returns the number of decoded pairs,
+    // and if decoded_end is given sets it to the end of the last one: that is before end when the
+    // data is cut off within a pair.
+    static size_t decode_pairs(uint8_t const* begin, uint8_t const* end, uint64_t* amount_diffs, int32_t* block_height_diffs, uint8_t const** decoded_end = nullptr)
+    {
+        uint8_t const* p = begin;
+        size_t num_pairs = 0;
+
+#if defined(__AVX2__) || defined(BV_BULKVARINT_SSE2)
+        // each window needs 8 bytes of slack behind it for the 8 byte loads
+        while (end - p >= static_cast<ptrdiff_t>(window_size + 8)) {
+            uint32_t terminators = terminator_mask(p);
+
+            // decode all pairs that end inside this window. A pair that is only partially inside
+            // is decoded with the next window.
+            uint8_t const* const window_begin = p;
+            size_t start = 0;
+            while (has_two_bits(terminators)) {
+                auto const amount_end = ctz(terminators) + 1;
+                terminators &= terminators - 1;
+                auto const block_height_end = ctz(terminators) + 1;
+                terminators &= terminators - 1;
+
+                auto const amount_len = amount_end - start;
+                auto const block_height_len = block_height_end - amount_end;
+                if (amount_len > 8 || block_height_len > 5) {
+                    // only possible for huge values, never happens for real data. Let the scalar
+                    // path deal with it.
+                    break;
+                }
+                amount_diffs[num_pairs] = extract(window_begin + start, amount_len);
+                auto const v = static_cast<uint32_t>(extract(window_begin + amount_end, block_height_len));
+                block_height_diffs[num_pairs] = static_cast<int32_t>((v >> 1) ^ (0U - (v & 1)));
+                ++num_pairs;
+                start = block_height_end;
+            }
+            if (0 == start) {
+                // not even one pair fits into the window
+                break;
+            }
+            p = window_begin + start;
+        }
+#endif
+
+        // scalar tail, only for pairs whose two varints both end before end.
+        while (p != end) {
+            uint8_t const* pair_end = p;
+            int num_terminators = 0;
+            while (pair_end != end && num_terminators < 2) {
+                num_terminators += (*pair_end++ & 0b10000000) ? 0 : 1;
+            }
+            if (num_terminators < 2) {
+                break;
+            }
+            MemoryStreamReader msr(p, pair_end);
+            VarInt::decode_uint(msr, amount_diffs[num_pairs]);
+            VarInt::decode_int32(msr, block_height_diffs[num_pairs]);
+            ++num_pairs;
+            p = pair_end;
+        }
+
+        if (decoded_end) {
+            *decoded_end = p;
+        }
+        return num_pairs;
+    }
+
+private:
+#if defined(__AVX2__)
+    static size_t const window_size = 32;
+
+    // bit i is set when byte i has the high bit cleared, which ends a varint.
+    static uint32_t terminator_mask(uint8_t const* p)
+    {
+        auto const data = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+        return ~static_cast<uint32_t>(_mm256_movemask_epi8(data));
+    }
+#elif defined(BV_BULKVARINT_SSE2)
+    static size_t const window_size = 32;
+
+    // bit i is set when byte i has the high bit cleared, which ends a varint.
+    static uint32_t terminator_mask(uint8_t const* p)
+    {
+        auto const lo = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+        auto const hi = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 16));
+        return ~(static_cast<uint32_t>(_mm_movemask_epi8(lo)) | (static_cast<uint32_t>(_mm_movemask_epi8(hi)) << 16));
+    }
+#endif
+
+    static size_t ctz(uint32_t x)
+    {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanForward(&idx, x);
+        return idx;
+#else
+        return static_cast<size_t>(__builtin_ctz(x));
+#endif
+    }
+
+    // true if at least two bits are set
+    static bool has_two_bits(uint32_t x)
+    {
+        return 0 != (x & (x - 1));
+    }
+
+    // Value of the varint of len (1 to 8) bytes that starts at p. There must be 8 readable bytes.
+    static uint64_t extract(uint8_t const* p, size_t len)
+    {
+        uint64_t x;
+        std::memcpy(&x, p, sizeof(x));
+
+        // keep the len bytes of this varint, and only the 7 payload bits of each.
+        auto const mask = 0x7f7f7f7f7f7f7f7fULL >> (64 - 8 * len);
+#if defined(BV_BULKVARINT_PEXT)
+        return _pext_u64(x, mask);
+#else
+        x &= mask;
+
+        // squeeze out the gaps: 8x7 bits -> 4x14 bits -> 2x28 bits -> 56 bits
+        x = (x & 0x007f007f007f007fULL) | ((x & 0x7f007f007f007f00ULL) >> 1);
+        x = (x & 0x00003fff00003fffULL) | ((x & 0x3fff00003fff0000ULL) >> 2);
+        x = (x & 0x000000000fffffffULL) | ((x & 0x0fffffff00000000ULL) >> 4);
+        return x;
+#endif
+    }
+};
+
+} // namespace bv
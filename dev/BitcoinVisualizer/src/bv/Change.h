@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+namespace bv {
+
+// One change as it is stored in a .blk record: an output of amount satoshi, created in the block
+// with block_height, was added (amount >= 0) or removed (amount < 0).
+struct Change {
+    uint32_t block_height;
+    int64_t amount;
+};
+
+// the order of the changes within a .blk record: by amount, then by block height.
+inline bool is_before_in_record(Change const& a, Change const& b)
+{
+    return a.amount < b.amount || (a.amount == b.amount && a.block_height < b.block_height);
+}
+
+} // namespace bv
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <bv/DensityGrid.h>
+
+#include <cstdint>
+#include <limits>
+#include <string>
+
+namespace bv {
+
+// Everything that defines what is rendered, and where it goes. The defaults are the settings of
+// the 4K video.
+struct Config {
+    // resolution of the output. width * height has to fit into an uint32_t pixel index, and each
+    // of them needs to be < 65536 (see PixelMapper).
+    size_t width = 3840;
+    size_t height = 2160;
+
+    // amounts are mapped logarithmically, max_satoshi is the top row and min_satoshi the bottom row.
+    int64_t min_satoshi = 1;
+    int64_t max_satoshi = 10'000LL * 100'000'000;
+
+    // block heights are mapped linearly, min_block_height is the first column and
+    // max_block_height the last one.
+    uint32_t min_block_height = 0;
+    uint32_t max_block_height = 550'000;
+
+    // Frames are only emitted from start_block_height on, blocks before it are only integrated.
+    // Decoding stops after stop_block_height.
+    uint32_t start_block_height = 0;
+    uint32_t stop_block_height = std::numeric_limits<uint32_t>::max();
+
+    // densities at or above these values get the brightest color: for the streamed frames, and
+    // for the final image.
+    size_t stream_max_density = 2000;
+    size_t image_max_density = 444;
+
+    // Number of blocks that are integrated into one frame. Frame f shows everything up to block
+    // (f + 1) * blocks_per_frame - 1. If num_frames is set, blocks_per_frame is chosen instead so
+    // that the blocks from start_block_height to stop_block_height (or max_block_height) take
+    // about that many frames.
+    uint32_t blocks_per_frame = 1;
+    uint32_t num_frames = 0;
+
+    // If set, frames are paced by chain time instead: each frame covers seconds_per_frame of
+    // median block time, read from block_times_file (see ChainTimePacer).
+    uint32_t seconds_per_frame = 0;
+    std::string block_times_file = "headers.tsv";
+
+    // number of frames a changed pixel stays highlighted
+    size_t max_history = 50;
+
+    // Changed pixels also highlight their neighbours up to highlight_radius pixels away (1 to 3,
+    // see HighlightKernel). The further neighbours fade out sooner: the outermost ones are 15, 31
+    // or 47 frames older than the changed pixel. With a shorter max_history these are left out.
+    size_t highlight_radius = 1;
+
+    DensityGrid<>::Layout grid_layout = DensityGrid<>::Layout::linear;
+
+    // where the frames are streamed to, see SocketStream::create()
+    std::string sink = "127.0.0.1:12987";
+
+    // Number of frames that can be queued for the sink. While they are written, the next blocks
+    // are already integrated; when all of them are queued, integration waits for the sink.
+    size_t frame_buffers = 3;
+
+    // Send delta frames (see DeltaFrame) instead of raw RGB frames, with a keyframe every
+    // keyframe_interval frames.
+    bool delta_frames = false;
+    size_t keyframe_interval = 600;
+
+    // Send a YUV 4:4:4 Y4M stream (see Y4mFrameWriter) instead of raw RGB frames. frame_rate is
+    // only written into its header, or into the video encoded with an encode: sink.
+    bool y4m = false;
+    uint32_t frame_rate = 60;
+
+    uint32_t effective_blocks_per_frame() const
+    {
+        if (num_frames == 0) {
+            return blocks_per_frame;
+        }
+        auto const last_block_height = stop_block_height < max_block_height ? stop_block_height : max_block_height;
+        if (last_block_height < start_block_height) {
+            return 1;
+        }
+        auto const num_blocks = static_cast<uint64_t>(last_block_height - start_block_height) + 1;
+        auto const bpf = (num_blocks + num_frames - 1) / num_frames;
+        return static_cast<uint32_t>(bpf);
+    }
+
+    // Returns an error message if the configuration can't be rendered, or an empty string.
+    std::string validate() const
+    {
+        if (width == 0 || height == 0 || width > 65535 || height > 65535) {
+            return "width and height need to be between 1 and 65535";
+        }
+        if (width * height > 0xffffffffULL) {
+            return "width * height needs to fit into 32 bit";
+        }
+        if (min_satoshi < 1 || max_satoshi <= min_satoshi) {
+            return "satoshi range needs to be 1 <= min < max";
+        }
+        if (max_block_height <= min_block_height) {
+            return "block range needs to be min < max";
+        }
+        if (stop_block_height < start_block_height) {
+            return "stop block needs to be >= start block";
+        }
+        if (blocks_per_frame == 0) {
+            return "at least one block per frame is needed";
+        }
+        if (max_history == 0) {
+            return "changed pixels need to stay highlighted for at least one frame";
+        }
+        if (highlight_radius < 1 || highlight_radius > 3) {
+            return "highlight radius needs to be 1, 2 or 3";
+        }
+        if (frame_buffers == 0) {
+            return "at least one frame buffer is needed";
+        }
+        if (y4m && delta_frames) {
+            return "Y4M and delta frames can't be combined";
+        }
+        if (frame_rate == 0) {
+            return "frame rate needs to be > 0";
+        }
+        if (stream_max_density == 0 || image_max_density == 0) {
+            return "max densities need to be > 0";
+        }
+        return std::string();
+    }
+};
+
+} // namespace bv
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <bv/FrameWriter.h>
+#include <bv/SocketStream.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace bv {
+
+// Delta frame protocol: instead of the full RGB frame, only the spans of pixels that changed
+// since the previous frame are sent, with a keyframe every now and then. Early in the chain a
+// frame changes only a few hundred pixels, so this is a tiny fraction of the raw stream.
+// DeltaFrameReader (used by bv_receiver) reconstructs the full frames.
+//
+// Each frame is a message, all values little endian:
+//   uint32_t magic "BVDF", uint32_t type (keyframe or delta), uint32_t width, uint32_t height,
+//   uint32_t number of spans (0 for keyframes), then
+//   keyframe: width * height * 3 bytes RGB
+//   delta: for each span uint32_t first pixel_idx, uint32_t number of pixels, 3 bytes RGB per pixel.
+struct DeltaFrame {
+    enum Type : uint32_t { keyframe = 0, delta = 1 };
+
+    // "BVDF"
+    static uint32_t const magic = 0x46445642;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t type;
+        uint32_t width;
+        uint32_t height;
+        uint32_t num_spans;
+    };
+
+    struct Span {
+        uint32_t first_pixel_idx;
+        uint32_t num_pixels;
+    };
+};
+
+// Encodes frames as delta frames.
+class DeltaFrameWriter final : public FrameWriter
+{
+public:
+    // A keyframe is sent every keyframe_interval frames, so a receiver can recover from a broken
+    // frame. 0 sends only the necessary keyframes.
+    DeltaFrameWriter(std::unique_ptr<SocketStream> stream, size_t width, size_t height, size_t keyframe_interval)
+        : m_stream(std::move(stream)),
+          m_width(width),
+          m_height(height),
+          m_keyframe_interval(keyframe_interval),
+          m_num_frames_since_keyframe(0)
+    {
+    }
+
+    bool write(Frame const& frame) override
+    {
+        if (frame.is_all_changed || (m_keyframe_interval != 0 && m_num_frames_since_keyframe + 1 >= m_keyframe_interval) || !encode_delta(frame)) {
+            m_num_frames_since_keyframe = 0;
+            DeltaFrame::Header const header{DeltaFrame::magic, DeltaFrame::keyframe, static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height), 0};
+            SocketStream::Buffer const buffers[] = {{reinterpret_cast<uint8_t const*>(&header), sizeof(header)}, {frame.rgb.data(), frame.rgb.size()}};
+            return m_stream->writev(buffers, 2);
+        }
+
+        ++m_num_frames_since_keyframe;
+        return m_stream->write(m_message.data(), m_message.size());
+    }
+
+private:
+    // Spans are merged across gaps of up to this many unchanged pixels: resending 2 pixels (6
+    // bytes) is cheaper than the header of another span (8 bytes).
+    static uint32_t const max_gap = 2;
+
+    // Encodes the delta into m_message. Returns false if it wouldn't be smaller than a keyframe.
+    bool encode_delta(Frame const& frame)
+    {
+        m_pixels.assign(frame.changed_pixels.begin(), frame.changed_pixels.end());
+        std::sort(m_pixels.begin(), m_pixels.end());
+        m_pixels.erase(std::unique(m_pixels.begin(), m_pixels.end()), m_pixels.end());
+
+        m_message.resize(sizeof(DeltaFrame::Header));
+        uint32_t num_spans = 0;
+        size_t i = 0;
+        while (i < m_pixels.size()) {
+            auto const first_pixel_idx = m_pixels[i];
+            auto last_pixel_idx = first_pixel_idx;
+            ++i;
+            while (i < m_pixels.size() && m_pixels[i] - last_pixel_idx <= max_gap + 1) {
+                last_pixel_idx = m_pixels[i];
+                ++i;
+            }
+
+            DeltaFrame::Span const span{first_pixel_idx, last_pixel_idx - first_pixel_idx + 1};
+            auto const* rgb = frame.rgb.data() + 3 * static_cast<size_t>(first_pixel_idx);
+            append(&span, sizeof(span));
+            append(rgb, 3 * static_cast<size_t>(span.num_pixels));
+            ++num_spans;
+
+            if (m_message.size() >= frame.rgb.size()) {
+                return false;
+            }
+        }
+
+        DeltaFrame::Header const header{DeltaFrame::magic, DeltaFrame::delta, static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height), num_spans};
+        std::memcpy(m_message.data(), &header, sizeof(header));
+        return true;
+    }
+
+    void append(void const* data, size_t size)
+    {
+        auto const* p = static_cast<uint8_t const*>(data);
+        m_message.insert(m_message.end(), p, p + size);
+    }
+
+    std::unique_ptr<SocketStream> const m_stream;
+    size_t const m_width;
+    size_t const m_height;
+    size_t const m_keyframe_interval;
+    size_t m_num_frames_since_keyframe;
+    std::vector<uint32_t> m_pixels;
+    std::vector<uint8_t> m_message;
+};
+
+// Reads delta frames from a FILE and keeps the current full frame.
+class DeltaFrameReader
+{
+public:
+    enum class Result { ok, eof, error };
+
+    explicit DeltaFrameReader(FILE* file)
+        : m_file(file)
+    {
+    }
+
+    // Reads the next message and applies it to the frame. The first message needs to be a keyframe.
+    Result read()
+    {
+        DeltaFrame::Header header;
+        auto const num_read = fread(&header, 1, sizeof(header), m_file);
+        if (num_read == 0 && feof(m_file)) {
+            return Result::eof;
+        }
+        if (num_read != sizeof(header) || header.magic != DeltaFrame::magic) {
+            return Result::error;
+        }
+        if (m_rgb.empty()) {
+            if (header.type != DeltaFrame::keyframe || header.width == 0 || header.height == 0) {
+                return Result::error;
+            }
+            m_width = header.width;
+            m_height = header.height;
+            m_rgb.resize(3 * static_cast<size_t>(m_width) * m_height);
+        }
+        if (header.width != m_width || header.height != m_height) {
+            return Result::error;
+        }
+
+        if (header.type == DeltaFrame::keyframe) {
+            return read_bytes(m_rgb.data(), m_rgb.size()) ? Result::ok : Result::error;
+        }
+        if (header.type != DeltaFrame::delta) {
+            return Result::error;
+        }
+
+        auto const num_pixels_total = static_cast<uint64_t>(m_width) * m_height;
+        for (uint32_t i = 0; i < header.num_spans; ++i) {
+            DeltaFrame::Span span;
+            if (!read_bytes(&span, sizeof(span)) || static_cast<uint64_t>(span.first_pixel_idx) + span.num_pixels > num_pixels_total) {
+                return Result::error;
+            }
+            if (!read_bytes(m_rgb.data() + 3 * static_cast<size_t>(span.first_pixel_idx), 3 * static_cast<size_t>(span.num_pixels))) {
+                return Result::error;
+            }
+        }
+        return Result::ok;
+    }
+
+    // the current frame as RGB
+    std::vector<uint8_t> const& rgb() const
+    {
+        return m_rgb;
+    }
+
+    uint32_t width() const
+    {
+        return m_width;
+    }
+
+    uint32_t height() const
+    {
+        return m_height;
+    }
+
+private:
+    bool read_bytes(void* data, size_t size)
+    {
+        return size == fread(data, 1, size, m_file);
+    }
+
+    FILE* const m_file;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    std::vector<uint8_t> m_rgb;
+};
+
+} // namespace bv
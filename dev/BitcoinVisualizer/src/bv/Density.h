@@ -1,16 +1,32 @@
 #pragma once
 
+#include <bv/AsyncFrameSink.h>
+#include <bv/Change.h>
 #include <bv/ColorMap.h>
+#include <bv/Config.h>
+#include <bv/DensityGrid.h>
 #include <bv/DensityToImage.h>
+#include <bv/FramePacer.h>
+#include <bv/FrameWriter.h>
+#include <bv/HighlightKernel.h>
+#include <bv/HighlightOverlay.h>
 #include <bv/LinearFunction.h>
+#include <bv/MemoryStreamReader.h>
+#include <bv/PixelDelta.h>
+#include <bv/PixelMapper.h>
 #include <bv/PixelSet.h>
 #include <bv/PixelSetWithHistory.h>
-#include <bv/SocketStream.h>
-#include <bv/truncate.h>
+#include <bv/VarInt.h>
+#include <bv/prefetch.h>
 
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace bv {
@@ -19,19 +35,31 @@ namespace bv {
 class Density
 {
 public:
-    Density(size_t width, size_t height, int64_t min_satoshi, int64_t max_satoshi, double min_blockid, double max_blockid)
-        : m_width(width),
-          m_height(height),
-          m_min_satoshi(min_satoshi),
-          m_max_satoshi(max_satoshi),
-          m_fn_satoshi(std::log(max_satoshi), 0, std::log(min_satoshi), static_cast<double>(m_height)),
-          m_fn_block(static_cast<double>(min_blockid), 0, static_cast<double>(max_blockid), static_cast<double>(m_width)),
-          m_data(m_width * m_height, 0),
-          m_last_data(nullptr),
-          m_pixel_set_with_history(m_width * m_height, 50),
-          m_current_block_pixels(m_width * m_height),
-          m_socket_stream(SocketStream::create("127.0.0.1", 12987)),
-          m_density_to_image(m_width, m_height, 2000, bv::ColorMap::viridis()),
+    // The pacer decides which blocks go into which frame. Frames are written with frame_writer,
+    // on a separate thread (see AsyncFrameSink).
+    Density(Config const& config, std::unique_ptr<FramePacer> frame_pacer, std::unique_ptr<FrameWriter> frame_writer)
+        : m_width(config.width),
+          m_height(config.height),
+          m_min_satoshi(config.min_satoshi),
+          m_max_satoshi(config.max_satoshi),
+          m_fn_satoshi(std::log(m_max_satoshi), 0, std::log(m_min_satoshi), static_cast<double>(m_height)),
+          m_fn_block(static_cast<double>(config.min_block_height), 0, static_cast<double>(config.max_block_height), static_cast<double>(m_width)),
+          m_pixel_mapper(m_width, m_height, m_fn_satoshi, m_fn_block, static_cast<double>(config.max_block_height)),
+          m_data(m_width, m_height, config.grid_layout),
+          m_pixel_set_with_history(m_width * m_height, config.max_history),
+          m_highlight_overlay(config.max_history),
+          m_highlight_radius(config.highlight_radius),
+          m_current_frame_pixels(m_width * m_height),
+          m_density_to_image(m_width, m_height, config.stream_max_density, bv::ColorMap::viridis()),
+          m_frame_sink(std::move(frame_writer), m_density_to_image.size(), config.frame_buffers),
+          m_frame_diffs(m_frame_sink.num_buffers()),
+          m_next_frame_diff(0),
+          m_start_block_height(config.start_block_height),
+          m_frame_pacer(std::move(frame_pacer)),
+          m_start_frame(m_frame_pacer->lookup_frame_of(m_start_block_height)),
+          m_blocks_per_frame(config.seconds_per_frame != 0 ? 0 : config.effective_blocks_per_frame()),
+          m_seconds_per_frame(config.seconds_per_frame),
+          m_is_image_outdated(false),
           m_current_block_height(0)
     {
     }
@@ -41,165 +69,423 @@ public:
         m_current_block_height = block_height;
     }
 
-    void change(uint32_t block_height, int64_t amount, bool is_same_as_previous_change)
+    // Changes are only collected here, and integrated all at once with apply_block() in end_block().
+    void change(uint32_t block_height, int64_t amount, bool /*is_same_as_previous_change*/)
     {
-        if (is_same_as_previous_change) {
-            *m_last_data += amount >= 0 ? 1 : -1;
+        m_block_changes.push_back({block_height, amount});
+    }
+
+    // Integrates all changes of the current block at once. First maps them all to their pixels in
+    // one tight loop, then updates the density of each pixel in a single pass with apply().
+    void apply_block(Change const* changes, size_t count)
+    {
+        m_block_pixel_deltas.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            m_block_pixel_deltas[i] = {pixel_idx(changes[i].block_height, changes[i].amount), changes[i].amount >= 0 ? 1 : -1};
+        }
+        apply(m_block_pixel_deltas.data(), m_block_pixel_deltas.size());
+    }
+
+    // Applies already mapped changes (see pixel_idx()) of the current block. The pixels are spread
+    // all over the image, so each update is a cache miss. Since we know all pixels up front we
+    // prefetch a few ahead, so the misses overlap.
+    void apply(PixelDelta const* pixel_deltas, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            if (i + prefetch_distance < count) {
+                prefetch(m_data.address(pixel_deltas[i + prefetch_distance].pixel_idx));
+            }
+            auto const& pd = pixel_deltas[i];
+            m_data.add(pd.pixel_idx, pd.delta);
+            m_current_frame_pixels.insert(pd.pixel_idx);
+        }
+    }
+
+    // Maps a change to the pixel it is integrated into. Doesn't modify any state, so it is safe to
+    // call concurrently, e.g. from decoding threads.
+    uint32_t pixel_idx(uint32_t block_height, int64_t amount) const
+    {
+        return m_pixel_mapper.pixel_idx(block_height, amount);
+    }
+
+    // Integrates the block. The frame pacer decides which blocks go into a frame: after the last
+    // block of each frame, the pixels that changed in all its blocks are colorized and
+    // highlighted at once. When no block at all falls into a frame (e.g. chain time pacing in
+    // 2009), the frame is still emitted, so time passes evenly.
+    void end_block(uint32_t block_height)
+    {
+        if (!m_block_changes.empty()) {
+            apply_block(m_block_changes.data(), m_block_changes.size());
+            m_block_changes.clear();
+        }
+
+        auto const frame = m_frame_pacer->frame_of(block_height);
+        auto const next_frame = m_frame_pacer->frame_of(block_height + 1);
+        if (next_frame == frame) {
             return;
         }
 
-        size_t pixel_x = static_cast<size_t>(m_fn_block(block_height));
-        if (pixel_x > m_width - 1) {
-            pixel_x = m_width - 1;
+        auto const is_started = block_height >= m_start_block_height;
+        end_frame(frame, is_started);
+        if (is_started) {
+            for (auto empty_frame = frame + 1; empty_frame < next_frame; ++empty_frame) {
+                end_frame(empty_frame, true);
+            }
         }
+    }
 
-        auto const famount = amount >= 0 ? amount : -amount;
-        size_t const pixel_y = truncate<size_t>(0, static_cast<size_t>(m_fn_satoshi(std::log(famount))), m_height - 1);
+    // Ends the frame of the last block if that is still open, and then emits num_frames more
+    // frames without any new blocks, so the highlights fade out.
+    void append_still_frames(size_t num_frames)
+    {
+        auto const block_height = m_current_block_height;
+        auto const frame = m_frame_pacer->frame_of(block_height);
+        if (m_frame_pacer->frame_of(block_height + 1) == frame) {
+            end_frame(frame, block_height >= m_start_block_height);
+        }
+        for (size_t i = 1; i <= num_frames; ++i) {
+            end_frame(frame + static_cast<uint32_t>(i), true);
+        }
+    }
 
-        size_t const pixel_idx = pixel_y * m_width + pixel_x;
-        static size_t max_pixel_idx = 0;
-        if (pixel_idx > max_pixel_idx) {
-            max_pixel_idx = pixel_idx;
+    // saves current status of the image as a PPM file, colorized with toi.
+    void save_image_ppm(bv::DensityToImage& toi, std::string filename)
+    {
+        for (size_t pixel_idx = 0; pixel_idx < m_data.size(); ++pixel_idx) {
+            toi.update(pixel_idx, m_data[pixel_idx]);
         }
-        m_last_data = &m_data[pixel_idx];
-        *m_last_data += amount >= 0 ? 1 : -1;
 
-        // integrate density into image
-        //m_density_image.update(pixel_idx, pixel);
-        m_current_block_pixels.insert(pixel_idx);
+        // see http://netpbm.sourceforge.net/doc/ppm.html
+        std::ofstream fout(filename, std::ios::binary);
+        fout << "P6\n"
+             << m_width << " " << m_height << "\n"
+             << 255 << "\n"
+             << toi;
     }
 
-    void end_block(uint32_t block_height)
+    // Waits until all frames are written. Returns false if a frame could not be written completely.
+    bool flush()
+    {
+        return m_frame_sink.flush();
+    }
+
+    uint32_t current_block_height() const
+    {
+        return m_current_block_height;
+    }
+
+    // Writes the complete state after the last end_block() into a compact binary checkpoint, so
+    // rendering can later continue from here with load_checkpoint() instead of replaying
+    // everything from the genesis block.
+    //
+    // Format: "BVCP", uint32_t version, uint64_t width, uint64_t height, uint32_t blocks per frame,
+    // uint32_t seconds per frame (one of them is 0), uint32_t block height,
+    // uint64_t number of non-empty pixels followed by varint (pixel_idx delta, density) pairs,
+    // uint64_t number of history entries followed by varint (frame, pixel_idx) pairs,
+    // uint64_t number of pixels changed in the unfinished frame followed by varint pixel_idx, "BVCE".
+    // The image is not stored: each pixel's color is fully determined by its density, so it is
+    // recalculated on load.
+    bool save_checkpoint(std::string const& filename) const
+    {
+        std::vector<uint8_t> buf;
+        append(buf, checkpoint_magic);
+        append(buf, checkpoint_version);
+        append(buf, static_cast<uint64_t>(m_width));
+        append(buf, static_cast<uint64_t>(m_height));
+        append(buf, m_blocks_per_frame);
+        append(buf, m_seconds_per_frame);
+        append(buf, m_current_block_height);
+
+        uint64_t num_nonempty = 0;
+        for (size_t pixel_idx = 0; pixel_idx < m_data.size(); ++pixel_idx) {
+            num_nonempty += 0 != m_data[pixel_idx] ? 1 : 0;
+        }
+        append(buf, num_nonempty);
+        size_t previous_pixel_idx = 0;
+        for (size_t pixel_idx = 0; pixel_idx < m_data.size(); ++pixel_idx) {
+            if (0 != m_data[pixel_idx]) {
+                VarInt::encode_uint(buf, pixel_idx - previous_pixel_idx);
+                VarInt::encode_uint(buf, m_data[pixel_idx]);
+                previous_pixel_idx = pixel_idx;
+            }
+        }
+
+        append(buf, static_cast<uint64_t>(m_pixel_set_with_history.size()));
+        for (auto const& frame_pixelidx : m_pixel_set_with_history) {
+            VarInt::encode_uint(buf, frame_pixelidx.frame);
+            VarInt::encode_uint(buf, frame_pixelidx.pixel_idx);
+        }
+
+        append(buf, static_cast<uint64_t>(m_current_frame_pixels.size()));
+        for (auto const pixel_idx : m_current_frame_pixels) {
+            VarInt::encode_uint(buf, pixel_idx);
+        }
+        append(buf, checkpoint_end_magic);
+
+        std::ofstream fout(filename, std::ios::binary);
+        fout.write(reinterpret_cast<char const*>(buf.data()), buf.size());
+        return fout.good();
+    }
+
+    // Restores the state written by save_checkpoint(). Returns false if the file can't be read,
+    // is broken, or was written for a different resolution or frame pacing.
+    bool load_checkpoint(std::string const& filename)
     {
-        //if (block_height < 200'000) {
-        //    return;
-        //}
-        if (block_height >= 200'000) {
-            exit(0);
+        std::ifstream fin(filename, std::ios::binary);
+        if (!fin.is_open()) {
+            return false;
         }
+        std::vector<uint8_t> buf{std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>()};
+        MemoryStreamReader msr(buf.data(), buf.data() + buf.size());
 
-        for (auto const pixel_idx : m_current_block_pixels) {
-            m_density_to_image.update(pixel_idx, m_data[pixel_idx]);
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        uint64_t width = 0;
+        uint64_t height = 0;
+        uint32_t blocks_per_frame = 0;
+        uint32_t seconds_per_frame = 0;
+        msr.read(magic);
+        msr.read(version);
+        msr.read(width);
+        msr.read(height);
+        msr.read(blocks_per_frame);
+        msr.read(seconds_per_frame);
+        if (magic != checkpoint_magic || version != checkpoint_version || width != m_width || height != m_height
+            || blocks_per_frame != m_blocks_per_frame || seconds_per_frame != m_seconds_per_frame) {
+            return false;
         }
+        msr.read(m_current_block_height);
 
-        for (auto const pixel_idx : m_current_block_pixels) {
-            size_t const y = pixel_idx / m_width;
-            size_t const x = pixel_idx - y * m_width;
-
-            // make sure we don't get an overflow!
-            /*
-            if (m_current_block_height >= 15 && x > 0 && x + 1 < m_width && y > 0 && y + 1 < m_height) {
-                m_pixel_set_with_history.insert(m_current_block_height - 15, pixel_idx - m_width - 1);
-                m_pixel_set_with_history.insert(m_current_block_height - 07, pixel_idx - m_width);
-                m_pixel_set_with_history.insert(m_current_block_height - 15, pixel_idx - m_width + 1);
-                m_pixel_set_with_history.insert(m_current_block_height - 15, pixel_idx - 1);
-                m_pixel_set_with_history.insert(m_current_block_height -  0, pixel_idx);
-                m_pixel_set_with_history.insert(m_current_block_height - 15, pixel_idx + 1);
-                m_pixel_set_with_history.insert(m_current_block_height - 15, pixel_idx + m_width - 1);
-                m_pixel_set_with_history.insert(m_current_block_height - 07, pixel_idx + m_width);
-                m_pixel_set_with_history.insert(m_current_block_height - 15, pixel_idx + m_width + 1);
+        m_data.clear();
+        uint64_t num_nonempty = 0;
+        msr.read(num_nonempty);
+        size_t pixel_idx = 0;
+        for (uint64_t i = 0; i < num_nonempty; ++i) {
+            if (msr.eof()) {
+                return false;
             }
-			*/
-
-            if (m_current_block_height >= 15) {
-                // upper row
-                if (x > 0) {
-                    if (y > 0) {
-                        m_pixel_set_with_history.insert(m_current_block_height - 15, (y - 1) * m_width + (x - 1));
-                    }
-                    m_pixel_set_with_history.insert(m_current_block_height - 7, (y + 0) * m_width + (x - 1));
-                    if (y + 1 < m_height) {
-                        m_pixel_set_with_history.insert(m_current_block_height - 15, (y + 1) * m_width + (x - 1));
-                    }
-                }
+            size_t pixel_idx_delta;
+            VarInt::decode_uint(msr, pixel_idx_delta);
+            pixel_idx += pixel_idx_delta;
+            if (pixel_idx >= m_data.size()) {
+                return false;
+            }
+            size_t density;
+            VarInt::decode_uint(msr, density);
+            m_data.set(pixel_idx, density);
+        }
+        update_image();
 
-                // middle row
-                if (y > 0) {
-                    m_pixel_set_with_history.insert(m_current_block_height - 7, (y - 1) * m_width + (x + 0));
-                }
-                m_pixel_set_with_history.insert(m_current_block_height, pixel_idx);
-                if (y + 1 < m_height) {
-                    m_pixel_set_with_history.insert(m_current_block_height - 7, (y + 1) * m_width + (x + 0));
-                }
+        m_pixel_set_with_history.clear();
+        uint64_t num_history = 0;
+        msr.read(num_history);
+        for (uint64_t i = 0; i < num_history; ++i) {
+            if (msr.eof()) {
+                return false;
+            }
+            uint32_t frame;
+            VarInt::decode_uint(msr, frame);
+            VarInt::decode_uint(msr, pixel_idx);
+            if (pixel_idx >= m_data.size()) {
+                return false;
+            }
+            m_pixel_set_with_history.insert(frame, pixel_idx);
+        }
 
-                // lower row
-                if (x + 1 < m_width) {
-                    if (y > 0) {
-                        m_pixel_set_with_history.insert(m_current_block_height - 15, (y - 1) * m_width + (x + 1));
-                    }
-                    m_pixel_set_with_history.insert(m_current_block_height - 7, (y + 0) * m_width + (x + 1));
-                    if (y + 1 < m_height) {
-                        m_pixel_set_with_history.insert(m_current_block_height - 15, (y + 1) * m_width + (x + 1));
-                    }
-                }
+        m_current_frame_pixels.clear();
+        uint64_t num_frame_pixels = 0;
+        msr.read(num_frame_pixels);
+        for (uint64_t i = 0; i < num_frame_pixels; ++i) {
+            if (msr.eof()) {
+                return false;
             }
+            VarInt::decode_uint(msr, pixel_idx);
+            if (pixel_idx >= m_data.size()) {
+                return false;
+            }
+            m_current_frame_pixels.insert(pixel_idx);
         }
-        m_pixel_set_with_history.age(block_height);
+        m_block_changes.clear();
 
+        uint32_t end_magic = 0;
+        msr.read(end_magic);
+        return end_magic == checkpoint_end_magic;
+    }
 
-        // temporarily set all updated pixels to white
-        std::vector<uint8_t> previous_rgb_values(3 * m_pixel_set_with_history.size());
-        auto previous_rgb_data = previous_rgb_values.data();
+private:
+    // The frame is complete. It is only emitted from the start block on.
+    void end_frame(uint32_t frame, bool is_started)
+    {
+        // Pixels that changed within max_history frames before the start are still highlighted in
+        // the first frame, so the history is kept from there on.
+        if (frame + m_pixel_set_with_history.max_history() >= m_start_frame) {
+            update_history(frame);
+        }
 
-        int const max_hist = static_cast<int>(m_pixel_set_with_history.max_history());
-        for (auto const& blockheight_pixelidx : m_pixel_set_with_history) {
-            int const x = block_height - blockheight_pixelidx.block_height;
+        if (!is_started) {
+            // no frames before the start: only integrate, the image is updated all at once later.
+            m_is_image_outdated = true;
+            m_current_frame_pixels.clear();
+            return;
+        }
 
-            int const fact = (2 * x + max_hist) / 3;
-            int const opposite = (max_hist - x) / 170; // 255 * 2 / 3 = 170
+        if (m_is_image_outdated) {
+            update_image();
+        } else {
+            m_density_to_image.update(m_current_frame_pixels.begin(), m_current_frame_pixels.end(), m_data);
+            if (m_frame_sink.is_ok()) {
+                for (auto& diff : m_frame_diffs) {
+                    diff.add(m_current_frame_pixels);
+                }
+                m_last_frame_diff.add(m_current_frame_pixels);
+            }
+        }
 
-            auto rgb = m_density_to_image.rgb(blockheight_pixelidx.pixel_idx);
-            *previous_rgb_data++ = rgb[0];
-            *previous_rgb_data++ = rgb[1];
-            *previous_rgb_data++ = rgb[2];
+        // once the sink is broken (e.g. ffmpeg was closed) there is no point in rendering any more frames
+        if (m_frame_sink.is_ok()) {
+            emit_frame(frame);
+        }
 
-            rgb[0] = (rgb[0] * fact + opposite) / max_hist;
-            rgb[1] = (rgb[1] * fact + opposite) / max_hist;
-            rgb[2] = (rgb[2] * fact + opposite) / max_hist;
+        m_current_frame_pixels.clear();
+    }
+
+    // highlights the pixels changed in this frame and their neighbours, and forgets old highlights.
+    void update_history(uint32_t frame)
+    {
+        switch (m_highlight_radius) {
+        case 2:
+            highlight(HighlightKernel<2>(m_width, m_height), frame);
+            break;
+        case 3:
+            highlight(HighlightKernel<3>(m_width, m_height), frame);
+            break;
+        default:
+            highlight(HighlightKernel<1>(m_width, m_height), frame);
+            break;
         }
+        m_pixel_set_with_history.age(frame);
+    }
 
-        //if (block_height > 400'000) {
-        m_socket_stream->write(m_density_to_image.data(), m_density_to_image.size());
-        //}
+    template <size_t Radius>
+    void highlight(HighlightKernel<Radius> const& kernel, uint32_t frame)
+    {
+        for (auto const pixel_idx : m_current_frame_pixels) {
+            kernel.insert(m_pixel_set_with_history, frame, pixel_idx);
+        }
+    }
 
-        // now re-update all the updated pixels that have changed since the last update
-        previous_rgb_data = previous_rgb_values.data();
-        for (auto const& blockheight_pixelidx : m_pixel_set_with_history) {
-            m_density_to_image.rgb(blockheight_pixelidx.pixel_idx, previous_rgb_data);
-            previous_rgb_data += 3;
+    // The frame is the image with all recently updated pixels highlighted (see HighlightOverlay).
+    // It is composed in a buffer of the frame sink, so the image itself is never modified and the
+    // next block can be integrated while the frame is still being written.
+    //
+    // Copying the whole image for every frame would be much slower than the rest of the work, so
+    // for each buffer we remember which of its pixels differ from the image: the ones it
+    // highlighted, and the ones that changed since it was filled. Only those are copied again.
+    // The same is tracked for the previous frame, so the frame knows what changed since then.
+    void emit_frame(uint32_t frame_number)
+    {
+        auto& frame = m_frame_sink.acquire();
+        auto& diff = m_frame_diffs[m_next_frame_diff];
+        m_next_frame_diff = (m_next_frame_diff + 1) % m_frame_diffs.size();
+
+        auto* const rgb_frame = frame.rgb.data();
+        if (diff.is_outdated) {
+            m_density_to_image.expand(rgb_frame);
+        } else {
+            for (auto const pixel_idx : diff.stale_pixels) {
+                std::memcpy(rgb_frame + 3 * static_cast<size_t>(pixel_idx), m_density_to_image.rgb(pixel_idx), 3);
+            }
         }
+        diff.is_outdated = false;
+        diff.stale_pixels.clear();
+
+        m_highlight_overlay.composite(m_pixel_set_with_history, frame_number, m_density_to_image, rgb_frame, diff.stale_pixels);
 
-        //save_image_ppm(toi, fname);
-        //m_pixel_set.clear();
-        //}
+        // changed since the previous frame: everything where it differed from the image, and
+        // everything highlighted now.
+        frame.is_all_changed = m_last_frame_diff.is_outdated;
+        frame.changed_pixels.swap(m_last_frame_diff.stale_pixels);
+        frame.changed_pixels.insert(frame.changed_pixels.end(), diff.stale_pixels.begin(), diff.stale_pixels.end());
+        m_last_frame_diff.is_outdated = false;
+        m_last_frame_diff.stale_pixels = diff.stale_pixels;
 
-        m_current_block_pixels.clear();
+        m_frame_sink.submit();
     }
 
-    // saves current status of the image as a PPM file
-    void save_image_ppm(bv::DensityToImage& toi, std::string filename)
+    // recalculates the colors of all pixels
+    void update_image()
     {
-        // see http://netpbm.sourceforge.net/doc/ppm.html
-        std::ofstream fout(filename, std::ios::binary);
-        fout << "P6\n"
-             << m_width << " " << m_height << "\n"
-             << 255 << "\n"
-             << toi;
+        for (size_t pixel_idx = 0; pixel_idx < m_data.size(); ++pixel_idx) {
+            m_density_to_image.update(pixel_idx, m_data[pixel_idx]);
+        }
+        m_is_image_outdated = false;
+        for (auto& diff : m_frame_diffs) {
+            diff.invalidate();
+        }
+        m_last_frame_diff.invalidate();
+    }
+
+    // where a frame differs from the image.
+    struct FrameDiff {
+        // everything may differ
+        bool is_outdated = true;
+
+        // pixels that differ from the image, if not outdated. May contain duplicates.
+        std::vector<uint32_t> stale_pixels;
+
+        // the pixels were changed in the image
+        void add(PixelSet const& pixels)
+        {
+            if (!is_outdated) {
+                stale_pixels.insert(stale_pixels.end(), pixels.begin(), pixels.end());
+            }
+        }
+
+        // the whole image was changed
+        void invalidate()
+        {
+            is_outdated = true;
+            stale_pixels.clear();
+        }
+    };
+
+    // "BVCP" and "BVCE"
+    static uint32_t const checkpoint_magic = 0x50435642;
+    static uint32_t const checkpoint_end_magic = 0x45435642;
+    static uint32_t const checkpoint_version = 3;
+
+    template <typename T>
+    static void append(std::vector<uint8_t>& buf, T val)
+    {
+        auto const* p = reinterpret_cast<uint8_t const*>(&val);
+        buf.insert(buf.end(), p, p + sizeof(T));
     }
 
-private:
     size_t const m_width;
     size_t const m_height;
     int64_t const m_min_satoshi;
     int64_t const m_max_satoshi;
     LinearFunction const m_fn_satoshi;
     LinearFunction const m_fn_block;
-    std::vector<size_t> m_data;
-    size_t* m_last_data;
+    PixelMapper const m_pixel_mapper;
+    DensityGrid<> m_data;
+    std::vector<Change> m_block_changes;
+    std::vector<PixelDelta> m_block_pixel_deltas;
     PixelSetWithHistory m_pixel_set_with_history;
-    PixelSet m_current_block_pixels;
-    std::unique_ptr<SocketStream> m_socket_stream;
+    HighlightOverlay const m_highlight_overlay;
+    size_t const m_highlight_radius;
+    PixelSet m_current_frame_pixels;
     DensityToImage m_density_to_image;
+    AsyncFrameSink m_frame_sink;
+    std::vector<FrameDiff> m_frame_diffs;
+    size_t m_next_frame_diff;
+    FrameDiff m_last_frame_diff;
+    uint32_t const m_start_block_height;
+    std::unique_ptr<FramePacer> const m_frame_pacer;
+    uint32_t const m_start_frame;
+    uint32_t const m_blocks_per_frame;
+    uint32_t const m_seconds_per_frame;
+    bool m_is_image_outdated;
     uint32_t m_current_block_height;
 };
 
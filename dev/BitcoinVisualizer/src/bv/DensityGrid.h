@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace bv {
+
+// The density counter of each pixel, indexed by pixel_idx = y * width + x.
+//
+// Almost all counters stay small, so they are stored with only sizeof(T) bytes (4 instead of 8 by
+// default, which halves the memory and the cache misses). Within a block a pixel can temporarily go
+// below 0 (an output is spent before the outputs that are created in the same block are added), so
+// the bits of T are interpreted as signed. A counter that doesn't fit is promoted: its slot is set
+// to a marker value and the real value moves into a side map, until it is small enough again.
+// Densities are returned as size_t, negative values wrap around just like the size_t counters did.
+//
+// With Layout::tiled the counters are stored in tiles of 4x4 pixels, so pixels that are close in
+// amount and block height share cache lines. Layout::linear stores them row by row.
+template <class T = uint32_t>
+class DensityGrid
+{
+    static_assert(std::is_unsigned<T>::value && sizeof(T) <= 4, "DensityGrid: T needs to be an unsigned type of at most 32 bit");
+
+public:
+    enum class Layout { linear, tiled };
+
+    DensityGrid(size_t width, size_t height, Layout layout = Layout::linear)
+        : m_width(width),
+          m_height(height),
+          m_layout(layout),
+          m_tiles_x((width + tile_size - 1) / tile_size),
+          m_counters(layout == Layout::tiled ? m_tiles_x * ((height + tile_size - 1) / tile_size) * tile_size * tile_size : width * height, 0)
+    {
+    }
+
+    // number of pixels
+    size_t size() const
+    {
+        return m_width * m_height;
+    }
+
+    size_t operator[](size_t pixel_idx) const
+    {
+        auto const c = m_counters[storage_idx(pixel_idx)];
+        if (c != promoted) {
+            return static_cast<size_t>(to_signed(c));
+        }
+        return static_cast<size_t>(m_overflow.find(pixel_idx)->second);
+    }
+
+    void add(size_t pixel_idx, int64_t delta)
+    {
+        auto& c = m_counters[storage_idx(pixel_idx)];
+        if (c != promoted) {
+            store(pixel_idx, c, to_signed(c) + delta);
+            return;
+        }
+
+        auto it = m_overflow.find(pixel_idx);
+        it->second += delta;
+        if (fits(it->second)) {
+            c = from_signed(it->second);
+            m_overflow.erase(it);
+        }
+    }
+
+    void set(size_t pixel_idx, size_t density)
+    {
+        auto& c = m_counters[storage_idx(pixel_idx)];
+        if (c == promoted) {
+            m_overflow.erase(pixel_idx);
+        }
+        store(pixel_idx, c, static_cast<int64_t>(density));
+    }
+
+    // sets all densities to 0
+    void clear()
+    {
+        std::fill(m_counters.begin(), m_counters.end(), static_cast<T>(0));
+        m_overflow.clear();
+    }
+
+    // where the counter of the pixel is stored, e.g. for prefetching.
+    void const* address(size_t pixel_idx) const
+    {
+        return &m_counters[storage_idx(pixel_idx)];
+    }
+
+    // number of pixels whose density doesn't fit into T
+    size_t num_promoted() const
+    {
+        return m_overflow.size();
+    }
+
+private:
+    using S = typename std::make_signed<T>::type;
+
+    static size_t const tile_size = 4;
+
+    // the smallest signed value marks a promoted counter, so it is not used as a density.
+    static T const promoted = static_cast<T>(T(1) << (8 * sizeof(T) - 1));
+
+    static int64_t to_signed(T c)
+    {
+        return static_cast<int64_t>(static_cast<S>(c));
+    }
+
+    static T from_signed(int64_t density)
+    {
+        return static_cast<T>(static_cast<S>(density));
+    }
+
+    static bool fits(int64_t density)
+    {
+        return density > std::numeric_limits<S>::min() && density <= std::numeric_limits<S>::max();
+    }
+
+    void store(size_t pixel_idx, T& c, int64_t density)
+    {
+        if (fits(density)) {
+            c = from_signed(density);
+        } else {
+            c = promoted;
+            m_overflow[pixel_idx] = density;
+        }
+    }
+
+    size_t storage_idx(size_t pixel_idx) const
+    {
+        if (m_layout == Layout::linear) {
+            return pixel_idx;
+        }
+        auto const y = pixel_idx / m_width;
+        auto const x = pixel_idx - y * m_width;
+        auto const tile_idx = (y / tile_size) * m_tiles_x + x / tile_size;
+        return tile_idx * tile_size * tile_size + (y % tile_size) * tile_size + x % tile_size;
+    }
+
+    size_t const m_width;
+    size_t const m_height;
+    Layout const m_layout;
+    size_t const m_tiles_x;
+    std::vector<T> m_counters;
+    std::unordered_map<size_t, int64_t> m_overflow;
+};
+
+} // namespace bv
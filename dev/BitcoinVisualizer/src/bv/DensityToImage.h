@@ -1,84 +1,154 @@
 #pragma once
 
 #include <bv/ColorMap.h>
+#include <bv/DensityGrid.h>
+#include <bv/prefetch.h>
 #include <bv/truncate.h>
 
+#include <cmath>
 #include <cstdint>
+#include <ostream>
 #include <vector>
 
 namespace bv {
 
 // maps density data to image data. It does so continously, so we don't have to iterate
 // the whole density map each time we want to extract the image.
+//
+// Every color of the image comes from the colormap, or is black. So the image only stores one
+// palette index per pixel, a third of the memory RGB would need, and updating a pixel writes a
+// single byte. The RGB colors are looked up in the palette when a frame is composed, see rgb()
+// and expand().
 class DensityToImage
 {
 public:
     DensityToImage(size_t width, size_t height, size_t max_included_value, ColorMap const& colormap)
-        : m_colormap(colormap),
-          m_width(width),
+        : m_width(width),
           m_height(height),
+          m_palette(3 * 256),
           // initialize with background color
-          m_rgb(3 * width * height, 0),
+          m_index(width * height, static_cast<uint8_t>(black_idx)),
           // calculates the factor so that max_value is the last integer value that mapps to 255.
           m_fact(256.0 / std::log(max_included_value + 1)),
-          m_max_included_value(max_included_value)
+          m_max_included_value(max_included_value),
+          m_lut_size(max_included_value < max_lut_size ? max_included_value + 1 : static_cast<size_t>(max_lut_size)),
+          m_lut(m_lut_size)
     {
+        for (size_t i = 0; i < 256; ++i) {
+            colormap.write_rgb(static_cast<int>(i), m_palette.data() + 3 * i);
+        }
+        m_palette[3 * black_idx] = 0;
+        m_palette[3 * black_idx + 1] = 0;
+        m_palette[3 * black_idx + 2] = 0;
+
+        // the palette indices of the densities up to max_included_value (or max_lut_size), so
+        // updating a pixel is only a lookup instead of a log.
+        for (size_t density = 0; density < m_lut_size; ++density) {
+            m_lut[density] = palette_idx(density);
+        }
     }
 
     void update(size_t pixel_idx, size_t density)
     {
-        static uint8_t black[3] = {0, 0, 0};
-        uint8_t const* rgb_source = nullptr;
-        if (0 == density) {
-            rgb_source = black;
-        } else if (density >= m_max_included_value) {
-            rgb_source = m_colormap.rgb(255);
-        } else {
-            auto log = std::log(density);
-            log *= m_fact;
-            auto log_int = static_cast<int>(log);
-            rgb_source = m_colormap.rgb(log_int);
+        m_index[pixel_idx] = density < m_lut_size ? m_lut[density] : palette_idx(density);
+    }
+
+    // Updates the pixels from first to last with their densities, prefetched like in
+    // Density::apply().
+    template <class PixelIt, class T>
+    void update(PixelIt first, PixelIt last, DensityGrid<T> const& densities)
+    {
+        auto const count = static_cast<size_t>(last - first);
+        for (size_t i = 0; i < count; ++i) {
+            if (i + prefetch_distance < count) {
+                auto const ahead_idx = static_cast<size_t>(first[i + prefetch_distance]);
+                prefetch(densities.address(ahead_idx));
+                prefetch(m_index.data() + ahead_idx);
+            }
+            auto const pixel_idx = static_cast<size_t>(first[i]);
+            update(pixel_idx, densities[pixel_idx]);
         }
-        rgb(pixel_idx, rgb_source);
     }
 
-    void rgb(size_t pixel_idx, uint8_t const* rgb_data)
+    // the 3 bytes RGB color of the pixel, in the palette.
+    uint8_t const* rgb(size_t pixel_idx) const
     {
-        m_rgb[pixel_idx * 3] = rgb_data[0];
-        m_rgb[pixel_idx * 3 + 1] = rgb_data[1];
-        m_rgb[pixel_idx * 3 + 2] = rgb_data[2];
+        return m_palette.data() + (3 * static_cast<size_t>(m_index[pixel_idx]));
     }
 
-    uint8_t* rgb(size_t pixel_idx)
+    // Writes the RGB colors of the pixels [first_pixel_idx, first_pixel_idx + num_pixels) into
+    // rgb_data, 3 bytes each.
+    void expand(size_t first_pixel_idx, size_t num_pixels, uint8_t* rgb_data) const
     {
-        return m_rgb.data() + (pixel_idx * 3);
+        auto const* index = m_index.data() + first_pixel_idx;
+        for (size_t i = 0; i < num_pixels; ++i) {
+            auto const* palette_rgb = m_palette.data() + (3 * static_cast<size_t>(index[i]));
+            rgb_data[0] = palette_rgb[0];
+            rgb_data[1] = palette_rgb[1];
+            rgb_data[2] = palette_rgb[2];
+            rgb_data += 3;
+        }
     }
 
-    uint8_t const* data() const
+    // Writes the RGB colors of the whole image into rgb_data, which needs size() bytes.
+    void expand(uint8_t* rgb_data) const
     {
-        return m_rgb.data();
+        expand(0, m_index.size(), rgb_data);
     }
 
-    // size in bytes
+    // size of the RGB image in bytes
     size_t size() const
     {
-        return m_rgb.size();
+        return 3 * m_index.size();
     }
 
 private:
     friend std::ostream& operator<<(std::ostream&, DensityToImage const&);
 
-    ColorMap const m_colormap;
+    // above this the densities are colorized with std::log instead of the lookup table.
+    static size_t const max_lut_size = 65536;
+
+    // Black needs a palette entry of its own. Colormap index 1 is never used: density 1 maps to
+    // index 0, and density 2 already to log(2) * m_fact >= 2, as m_fact is at least 256 / log(2^64).
+    static uint8_t const black_idx = 1;
+
+    uint8_t palette_idx(size_t density) const
+    {
+        if (0 == density) {
+            return black_idx;
+        }
+        if (density >= m_max_included_value) {
+            return 255;
+        }
+        auto log = std::log(density);
+        log *= m_fact;
+        return static_cast<uint8_t>(log);
+    }
+
     size_t const m_width;
     size_t const m_height;
-    std::vector<uint8_t> m_rgb;
+
+    // RGB colors by palette index, 3 bytes each
+    std::vector<uint8_t> m_palette;
+
+    // palette index of each pixel
+    std::vector<uint8_t> m_index;
     double const m_fact;
     size_t const m_max_included_value;
+
+    // palette indices by density
+    size_t const m_lut_size;
+    std::vector<uint8_t> m_lut;
 };
 
 std::ostream& operator<<(std::ostream& os, DensityToImage const& dti)
 {
-    os.write(reinterpret_cast<const char*>(dti.m_rgb.data()), dti.m_rgb.size());
+    // expanded row by row, so the RGB image is never in memory as a whole.
+    std::vector<uint8_t> row(3 * dti.m_width);
+    for (size_t y = 0; y < dti.m_height; ++y) {
+        dti.expand(y * dti.m_width, dti.m_width, row.data());
+        os.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
     return os;
 }
 
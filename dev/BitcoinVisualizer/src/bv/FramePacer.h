@@ -0,0 +1,164 @@
+#pragma once
+
+#include <bv/Config.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+
+namespace bv {
+
+// Decides which frame each block goes into. Frame numbers never decrease with the block height,
+// and a frame is complete when the next block goes into a later one.
+class FramePacer
+{
+public:
+    virtual ~FramePacer() = default;
+
+    // Frame of the block. Block heights are asked in increasing order, only the previous height
+    // may be asked again.
+    virtual uint32_t frame_of(uint32_t block_height) = 0;
+
+    // Same as frame_of(), for any block height. May be slow.
+    virtual uint32_t lookup_frame_of(uint32_t block_height) const = 0;
+
+    // Pacer for the config: by chain time if seconds_per_frame is set, otherwise by number of
+    // blocks. Returns nullptr if the block times can't be read.
+    static std::unique_ptr<FramePacer> create(Config const& config);
+};
+
+// A fixed number of blocks per frame.
+class BlockCountPacer final : public FramePacer
+{
+public:
+    explicit BlockCountPacer(uint32_t blocks_per_frame)
+        : m_blocks_per_frame(blocks_per_frame)
+    {
+    }
+
+    uint32_t frame_of(uint32_t block_height) override
+    {
+        return block_height / m_blocks_per_frame;
+    }
+
+    uint32_t lookup_frame_of(uint32_t block_height) const override
+    {
+        return block_height / m_blocks_per_frame;
+    }
+
+private:
+    uint32_t const m_blocks_per_frame;
+};
+
+// A fixed amount of chain time per frame, so e.g. 2010 with its small blocks and long gaps gets
+// the same screen time per day as 2017. Frame f shows everything with a median time before
+// genesis + (f + 1) * seconds_per_frame.
+//
+// The median times come from a text file with one "height<TAB>mediantime" line per block, in
+// order (headers.tsv, written by fetch_blockinfo.rb). The file is streamed along with the
+// blocks, so it doesn't need any memory no matter how long the chain is. Blocks after the last
+// line get the time of the last line.
+class ChainTimePacer final : public FramePacer
+{
+public:
+    // Returns nullptr if the file can't be opened or has no block times.
+    static std::unique_ptr<ChainTimePacer> open(std::string const& filename, uint32_t seconds_per_frame)
+    {
+        std::unique_ptr<ChainTimePacer> pacer(new ChainTimePacer(filename, seconds_per_frame));
+        if (!read_next(pacer->m_file, pacer->m_current)) {
+            return nullptr;
+        }
+        pacer->m_genesis_time = pacer->m_current.time;
+        pacer->m_previous = pacer->m_current;
+        return pacer;
+    }
+
+    uint32_t frame_of(uint32_t block_height) override
+    {
+        if (block_height <= m_previous.height) {
+            return frame_of_time(m_previous.time);
+        }
+        auto next = m_current;
+        while (m_current.height < block_height && read_next(m_file, next)) {
+            m_previous = m_current;
+            m_current = next;
+        }
+        return frame_of_time(m_current.time);
+    }
+
+    uint32_t lookup_frame_of(uint32_t block_height) const override
+    {
+        std::ifstream file(m_filename);
+        BlockTime bt{};
+        auto time = m_genesis_time;
+        while (read_next(file, bt) && bt.height <= block_height) {
+            time = bt.time;
+        }
+        return frame_of_time(time);
+    }
+
+private:
+    struct BlockTime {
+        uint32_t height;
+        int64_t time;
+    };
+
+    ChainTimePacer(std::string const& filename, uint32_t seconds_per_frame)
+        : m_filename(filename),
+          m_seconds_per_frame(seconds_per_frame),
+          m_file(filename)
+    {
+    }
+
+    // Reads the next valid line. Lines that can't be parsed (e.g. a header) are skipped. Returns
+    // false at the end of the file.
+    static bool read_next(std::istream& in, BlockTime& bt)
+    {
+        std::string line;
+        while (std::getline(in, line)) {
+            char* height_end = nullptr;
+            auto const height = std::strtoul(line.c_str(), &height_end, 10);
+            if (height_end == line.c_str() || *height_end != '\t') {
+                continue;
+            }
+            char* time_end = nullptr;
+            auto const time = std::strtoll(height_end + 1, &time_end, 10);
+            if (time_end == height_end + 1) {
+                continue;
+            }
+            bt.height = static_cast<uint32_t>(height);
+            bt.time = static_cast<int64_t>(time);
+            return true;
+        }
+        return false;
+    }
+
+    uint32_t frame_of_time(int64_t time) const
+    {
+        if (time <= m_genesis_time) {
+            return 0;
+        }
+        return static_cast<uint32_t>((time - m_genesis_time) / m_seconds_per_frame);
+    }
+
+    std::string const m_filename;
+    int64_t const m_seconds_per_frame;
+    std::ifstream m_file;
+    int64_t m_genesis_time = 0;
+
+    // the last block time that was read, and the one before it
+    BlockTime m_current{};
+    BlockTime m_previous{};
+};
+
+inline std::unique_ptr<FramePacer> FramePacer::create(Config const& config)
+{
+    if (config.seconds_per_frame != 0) {
+        return ChainTimePacer::open(config.block_times_file, config.seconds_per_frame);
+    }
+    return std::make_unique<BlockCountPacer>(config.effective_blocks_per_frame());
+}
+
+} // namespace bv
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <bv/SocketStream.h>
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace bv {
+
+// A rendered RGB frame, and what changed since the previous frame.
+struct Frame {
+    std::vector<uint8_t> rgb;
+
+    // if false, only the pixels in changed_pixels may differ from the previous frame.
+    bool is_all_changed = true;
+
+    // unsorted, and may contain duplicates. Only valid when is_all_changed is false.
+    std::vector<uint32_t> changed_pixels;
+};
+
+// Turns frames into bytes for a sink. Called by AsyncFrameSink on its writer thread, one frame
+// after the other.
+class FrameWriter
+{
+public:
+    virtual ~FrameWriter() = default;
+
+    // returns false if the frame could not be written completely.
+    virtual bool write(Frame const& frame) = 0;
+};
+
+// Writes each frame completely as raw RGB, e.g. for ffmpeg -f rawvideo -pix_fmt rgb24.
+class RawFrameWriter final : public FrameWriter
+{
+public:
+    explicit RawFrameWriter(std::unique_ptr<SocketStream> stream)
+        : m_stream(std::move(stream))
+    {
+    }
+
+    bool write(Frame const& frame) override
+    {
+        return m_stream->write(frame.rgb.data(), frame.rgb.size());
+    }
+
+private:
+    std::unique_ptr<SocketStream> const m_stream;
+};
+
+} // namespace bv
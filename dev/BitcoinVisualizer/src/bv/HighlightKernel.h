@@ -0,0 +1,96 @@
+#pragma once
+
+#include <bv/PixelSetWithHistory.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace bv {
+
+// The glow around a changed pixel: a (2 * Radius + 1) squared stencil of neighbours that are
+// highlighted as if they had changed a few frames earlier, so they fade out sooner. The further a
+// neighbour is away (in x plus y steps), the older it is: a direct neighbour by 7 frames, a
+// diagonal one by 15, and 8 more frames for each further step. Radius 1 is the classic 3x3 glow.
+//
+// The stencil is known at compile time, so for pixels whose whole stencil is inside the image it
+// is one unrolled loop of inserts at fixed index offsets, without any bounds checks. Only pixels
+// within Radius of the border are clipped tap by tap.
+template <size_t Radius>
+class HighlightKernel
+{
+public:
+    static size_t const size = 2 * Radius + 1;
+    static size_t const num_taps = size * size;
+
+    // how many frames older than the changed pixel the neighbour at (dx, dy) is highlighted.
+    static constexpr uint32_t age_of(int dx, int dy)
+    {
+        return (dx == 0 && dy == 0) ? 0 : 8 * static_cast<uint32_t>((dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy)) - 1;
+    }
+
+    // age of the corners, the oldest taps.
+    static constexpr uint32_t max_age()
+    {
+        return age_of(static_cast<int>(Radius), static_cast<int>(Radius));
+    }
+
+    HighlightKernel(size_t width, size_t height)
+        : m_width(width),
+          m_height(height)
+    {
+        // column by column, same order as the hand unrolled 3x3 glow had.
+        int const r = static_cast<int>(Radius);
+        size_t i = 0;
+        for (int dx = -r; dx <= r; ++dx) {
+            for (int dy = -r; dy <= r; ++dy) {
+                auto& tap = m_taps[i++];
+                tap.dx = dx;
+                tap.dy = dy;
+                tap.offset = static_cast<std::ptrdiff_t>(dy) * static_cast<std::ptrdiff_t>(width) + dx;
+                tap.age = age_of(dx, dy);
+            }
+        }
+    }
+
+    // Highlights the pixel that changed in frame, and its neighbours. Taps older than the frame
+    // number are skipped, so no frame number goes below 0, and so are taps older than the history:
+    // they would already be expired.
+    void insert(PixelSetWithHistory& highlights, uint32_t frame, uint32_t pixel_idx) const
+    {
+        auto const max_tap_age = frame < highlights.max_history() ? static_cast<size_t>(frame) : highlights.max_history();
+
+        size_t const y = pixel_idx / m_width;
+        size_t const x = pixel_idx - y * m_width;
+        if (max_tap_age >= max_age() && x >= Radius && x + Radius < m_width && y >= Radius && y + Radius < m_height) {
+            for (size_t i = 0; i < num_taps; ++i) {
+                highlights.insert(frame - m_taps[i].age, static_cast<size_t>(pixel_idx + m_taps[i].offset));
+            }
+            return;
+        }
+
+        // near the border, or not all taps are needed.
+        for (size_t i = 0; i < num_taps; ++i) {
+            auto const& tap = m_taps[i];
+            auto const tx = static_cast<std::ptrdiff_t>(x) + tap.dx;
+            auto const ty = static_cast<std::ptrdiff_t>(y) + tap.dy;
+            if (tap.age <= max_tap_age && tx >= 0 && tx < static_cast<std::ptrdiff_t>(m_width) && ty >= 0 && ty < static_cast<std::ptrdiff_t>(m_height)) {
+                highlights.insert(frame - tap.age, static_cast<size_t>(pixel_idx + tap.offset));
+            }
+        }
+    }
+
+private:
+    struct Tap {
+        int dx;
+        int dy;
+        std::ptrdiff_t offset;
+        uint32_t age;
+    };
+
+    size_t const m_width;
+    size_t const m_height;
+    std::array<Tap, num_taps> m_taps;
+};
+
+} // namespace bv
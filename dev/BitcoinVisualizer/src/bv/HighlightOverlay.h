@@ -0,0 +1,66 @@
+#pragma once
+
+#include <bv/DensityToImage.h>
+#include <bv/PixelSetWithHistory.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bv {
+
+// The highlights of recently changed pixels, as a layer over the image. The image itself is never
+// modified: the highlighted pixels are blended from the image straight into the frame buffer
+// while the frame is composed (see Density::emit_frame), so the image can be shared by any
+// number of frames in flight.
+//
+// The blended value only depends on the age of the highlight and on the value of the color
+// channel, so all of them are calculated once into a table. Compositing is then a lookup per
+// channel, instead of two integer divisions.
+class HighlightOverlay
+{
+public:
+    explicit HighlightOverlay(size_t max_history)
+        : m_max_age(max_history),
+          m_blend((max_history + 1) * 256)
+    {
+        // a new highlight has about a third of the color's value, and fades back to the color at max_history.
+        int const max_hist = static_cast<int>(max_history);
+        for (int age = 0; age <= max_hist; ++age) {
+            int const fact = (2 * age + max_hist) / 3;
+            int const opposite = (max_hist - age) / 170; // 255 * 2 / 3 = 170
+            for (int value = 0; value < 256; ++value) {
+                m_blend[static_cast<size_t>(age) * 256 + static_cast<size_t>(value)] = static_cast<uint8_t>((value * fact + opposite) / max_hist);
+            }
+        }
+    }
+
+    // Blends all highlighted pixels of the frame from the image into rgb_frame, and appends their
+    // indices to composited_pixels. The highlights need to be aged to frame_number (see
+    // PixelSetWithHistory::age()), so no age is beyond max_history.
+    void composite(PixelSetWithHistory const& highlights, uint32_t frame_number, DensityToImage const& image, uint8_t* rgb_frame, std::vector<uint32_t>& composited_pixels) const
+    {
+        for (auto const& frame_pixelidx : highlights) {
+            size_t age = frame_number - frame_pixelidx.frame;
+            if (age > m_max_age) {
+                age = m_max_age;
+            }
+            auto const* blend = m_blend.data() + age * 256;
+
+            auto const* rgb = image.rgb(frame_pixelidx.pixel_idx);
+            auto* frame_rgb = rgb_frame + 3 * static_cast<size_t>(frame_pixelidx.pixel_idx);
+            frame_rgb[0] = blend[rgb[0]];
+            frame_rgb[1] = blend[rgb[1]];
+            frame_rgb[2] = blend[rgb[2]];
+            composited_pixels.push_back(frame_pixelidx.pixel_idx);
+        }
+    }
+
+private:
+    size_t const m_max_age;
+
+    // blended value by age and value of the channel
+    std::vector<uint8_t> m_blend;
+};
+
+} // namespace bv
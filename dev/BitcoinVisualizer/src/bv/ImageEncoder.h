@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef BV_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace bv {
+
+// Lossless encoders for RGB frames (3 bytes per pixel, row by row).
+//
+// QOI (https://qoiformat.org) needs no dependencies and is very fast. The frames are mostly long
+// runs of the same color, so its files are even a bit smaller than the fast PNGs below. PNG needs
+// zlib, so it is only available when built with BV_WITH_ZLIB.
+class ImageEncoder
+{
+public:
+    static void qoi(uint8_t const* rgb, size_t width, size_t height, std::vector<uint8_t>& out)
+    {
+        out.clear();
+        out.reserve(14 + width * height / 4 + 8);
+
+        // header: magic, width, height, channels, colorspace (sRGB)
+        out.insert(out.end(), {'q', 'o', 'i', 'f'});
+        append_be32(out, static_cast<uint32_t>(width));
+        append_be32(out, static_cast<uint32_t>(height));
+        out.push_back(3);
+        out.push_back(0);
+
+        // The alpha is always 255, so QOI_OP_RGBA is never needed. The index still holds RGBA like
+        // the decoder's: its empty slots are {0, 0, 0, 0}, so they must not match a black pixel.
+        uint8_t index[64][4] = {};
+        uint8_t prev[3] = {0, 0, 0};
+        size_t run = 0;
+        auto const num_pixels = width * height;
+        for (size_t i = 0; i < num_pixels; ++i) {
+            auto const* px = rgb + 3 * i;
+            if (px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2]) {
+                ++run;
+                if (run == 62 || i + 1 == num_pixels) {
+                    out.push_back(static_cast<uint8_t>(op_run | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run != 0) {
+                out.push_back(static_cast<uint8_t>(op_run | (run - 1)));
+                run = 0;
+            }
+
+            auto const hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+            if (index[hash][0] == px[0] && index[hash][1] == px[1] && index[hash][2] == px[2] && index[hash][3] == 255) {
+                out.push_back(static_cast<uint8_t>(op_index | hash));
+            } else {
+                std::memcpy(index[hash], px, 3);
+                index[hash][3] = 255;
+
+                auto const dr = static_cast<int8_t>(px[0] - prev[0]);
+                auto const dg = static_cast<int8_t>(px[1] - prev[1]);
+                auto const db = static_cast<int8_t>(px[2] - prev[2]);
+                auto const dr_dg = static_cast<int8_t>(dr - dg);
+                auto const db_dg = static_cast<int8_t>(db - dg);
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    out.push_back(static_cast<uint8_t>(op_diff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                    out.push_back(static_cast<uint8_t>(op_luma | (dg + 32)));
+                    out.push_back(static_cast<uint8_t>((dr_dg + 8) << 4 | (db_dg + 8)));
+                } else {
+                    out.insert(out.end(), {op_rgb, px[0], px[1], px[2]});
+                }
+            }
+            std::memcpy(prev, px, 3);
+        }
+
+        // end marker
+        out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+    }
+
+#ifdef BV_WITH_ZLIB
+    // PNG with the Up filter and zlib level 1, which is a lot faster than the default level. The
+    // files are bigger, ffmpeg can squeeze them later. Returns false if zlib fails.
+    static bool png(uint8_t const* rgb, size_t width, size_t height, std::vector<uint8_t>& out)
+    {
+        out.clear();
+        out.insert(out.end(), {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'});
+
+        // IHDR: 8 bit RGB, no interlacing
+        std::vector<uint8_t> chunk;
+        append_be32(chunk, static_cast<uint32_t>(width));
+        append_be32(chunk, static_cast<uint32_t>(height));
+        chunk.insert(chunk.end(), {8, 2, 0, 0, 0});
+        append_chunk(out, "IHDR", chunk);
+
+        // IDAT: each row is filtered into a small buffer, and deflated from there.
+        z_stream zs{};
+        if (Z_OK != deflateInit(&zs, 1)) {
+            return false;
+        }
+        auto const row_size = 3 * width;
+        std::vector<uint8_t> row(1 + row_size);
+        chunk.resize(deflateBound(&zs, static_cast<uLong>((1 + row_size) * height)));
+        zs.next_out = chunk.data();
+        zs.avail_out = static_cast<uInt>(chunk.size());
+        bool is_ok = true;
+        for (size_t y = 0; y < height && is_ok; ++y) {
+            auto const* current = rgb + y * row_size;
+            if (y == 0) {
+                row[0] = filter_none;
+                std::memcpy(row.data() + 1, current, row_size);
+            } else {
+                row[0] = filter_up;
+                auto const* above = current - row_size;
+                for (size_t i = 0; i < row_size; ++i) {
+                    row[1 + i] = static_cast<uint8_t>(current[i] - above[i]);
+                }
+            }
+            zs.next_in = row.data();
+            zs.avail_in = static_cast<uInt>(row.size());
+            auto const is_last_row = y + 1 == height;
+            auto const ret = deflate(&zs, is_last_row ? Z_FINISH : Z_NO_FLUSH);
+            is_ok = zs.avail_in == 0 && ret == (is_last_row ? Z_STREAM_END : Z_OK);
+        }
+        chunk.resize(zs.total_out);
+        deflateEnd(&zs);
+        if (!is_ok) {
+            return false;
+        }
+        append_chunk(out, "IDAT", chunk);
+
+        chunk.clear();
+        append_chunk(out, "IEND", chunk);
+        return true;
+    }
+#endif
+
+private:
+    static uint8_t const op_index = 0x00;
+    static uint8_t const op_diff = 0x40;
+    static uint8_t const op_luma = 0x80;
+    static uint8_t const op_run = 0xc0;
+    static uint8_t const op_rgb = 0xfe;
+
+    static uint8_t const filter_none = 0;
+    static uint8_t const filter_up = 2;
+
+    static void append_be32(std::vector<uint8_t>& out, uint32_t x)
+    {
+        out.insert(out.end(), {static_cast<uint8_t>(x >> 24), static_cast<uint8_t>(x >> 16), static_cast<uint8_t>(x >> 8), static_cast<uint8_t>(x)});
+    }
+
+#ifdef BV_WITH_ZLIB
+    // length, type, data, crc of type and data
+    static void append_chunk(std::vector<uint8_t>& out, char const* type, std::vector<uint8_t> const& data)
+    {
+        append_be32(out, static_cast<uint32_t>(data.size()));
+        auto const type_pos = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        auto const crc = crc32(0, out.data() + type_pos, static_cast<uInt>(out.size() - type_pos));
+        append_be32(out, static_cast<uint32_t>(crc));
+    }
+#endif
+};
+
+} // namespace bv
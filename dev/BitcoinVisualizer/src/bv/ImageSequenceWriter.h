@@ -0,0 +1,211 @@
+#pragma once
+
+#include <bv/FrameWriter.h>
+#include <bv/ImageEncoder.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bv {
+
+// Writes each frame into its own image file, e.g. img/%08d.qoi. The files are numbered from 1 like
+// ffmpeg's image2 muxer does, so add_legend.rb and ffmpeg -i img/%08d.png can work on them.
+//
+// Encoding is by far the slowest part, so it is done by a pool of threads. write() copies the
+// frame into a free job buffer, and the number of the file is assigned right away, so the order of
+// the frames is kept no matter which thread finishes first. When all job buffers are busy,
+// write() waits.
+class ImageSequenceWriter final : public FrameWriter
+{
+public:
+    enum class Format { qoi, png };
+
+    // Returns nullptr if the pattern is not valid (see format_filename()), or the format is not
+    // supported by this build. The format is taken from the extension of the pattern.
+    static std::unique_ptr<ImageSequenceWriter> create(std::string const& pattern, size_t width, size_t height, size_t num_threads)
+    {
+        std::string filename;
+        if (!format_filename(pattern, 1, filename)) {
+            return nullptr;
+        }
+        Format format;
+        if (ends_with(pattern, ".qoi")) {
+            format = Format::qoi;
+        } else if (ends_with(pattern, ".png")) {
+#ifdef BV_WITH_ZLIB
+            format = Format::png;
+#else
+            return nullptr;
+#endif
+        } else {
+            return nullptr;
+        }
+        return std::unique_ptr<ImageSequenceWriter>(new ImageSequenceWriter(pattern, format, width, height, num_threads < 1 ? 1 : num_threads));
+    }
+
+    // waits until all images are written
+    ~ImageSequenceWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_is_done = true;
+        }
+        m_cv_worker.notify_all();
+        for (auto& t : m_threads) {
+            t.join();
+        }
+    }
+
+    bool write(Frame const& frame) override
+    {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv_writer.wait(lock, [&] { return !m_free_jobs.empty(); });
+            job = std::move(m_free_jobs.back());
+            m_free_jobs.pop_back();
+        }
+
+        job->rgb.assign(frame.rgb.begin(), frame.rgb.end());
+        job->number = ++m_num_frames;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queued_jobs.push_back(std::move(job));
+        }
+        m_cv_worker.notify_one();
+        return m_is_ok;
+    }
+
+    // Replaces the one %d (or %0Nd) in the pattern by number. Returns false if the pattern
+    // doesn't contain exactly one of them. %% is a single %.
+    static bool format_filename(std::string const& pattern, uint32_t number, std::string& filename)
+    {
+        filename.clear();
+        size_t num_numbers = 0;
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            if (pattern[i] != '%') {
+                filename += pattern[i];
+                continue;
+            }
+            ++i;
+            if (i < pattern.size() && pattern[i] == '%') {
+                filename += '%';
+                continue;
+            }
+            size_t width = 0;
+            while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9') {
+                width = width * 10 + static_cast<size_t>(pattern[i] - '0');
+                ++i;
+            }
+            if (i == pattern.size() || pattern[i] != 'd' || width > 20) {
+                return false;
+            }
+            auto digits = std::to_string(number);
+            if (digits.size() < width) {
+                digits.insert(0, width - digits.size(), '0');
+            }
+            filename += digits;
+            ++num_numbers;
+        }
+        return num_numbers == 1;
+    }
+
+private:
+    struct Job {
+        uint32_t number = 0;
+        std::vector<uint8_t> rgb;
+        std::vector<uint8_t> encoded;
+    };
+
+    ImageSequenceWriter(std::string const& pattern, Format format, size_t width, size_t height, size_t num_threads)
+        : m_pattern(pattern),
+          m_format(format),
+          m_width(width),
+          m_height(height),
+          m_is_ok(true)
+    {
+        // a few more jobs than threads, so the threads never have to wait for the next frame.
+        for (size_t i = 0; i < 2 * num_threads; ++i) {
+            m_free_jobs.push_back(std::make_unique<Job>());
+        }
+        for (size_t i = 0; i < num_threads; ++i) {
+            m_threads.emplace_back([this] { work(); });
+        }
+    }
+
+    static bool ends_with(std::string const& str, char const* suffix)
+    {
+        auto const len = std::char_traits<char>::length(suffix);
+        return str.size() >= len && 0 == str.compare(str.size() - len, len, suffix);
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_cv_worker.wait(lock, [&] { return !m_queued_jobs.empty() || m_is_done; });
+            if (m_queued_jobs.empty()) {
+                return;
+            }
+            auto job = std::move(m_queued_jobs.front());
+            m_queued_jobs.pop_front();
+            lock.unlock();
+
+            if (!encode_and_save(*job)) {
+                m_is_ok = false;
+            }
+
+            lock.lock();
+            m_free_jobs.push_back(std::move(job));
+            m_cv_writer.notify_one();
+        }
+    }
+
+    bool encode_and_save(Job& job) const
+    {
+        if (m_format == Format::qoi) {
+            ImageEncoder::qoi(job.rgb.data(), m_width, m_height, job.encoded);
+        } else {
+#ifdef BV_WITH_ZLIB
+            if (!ImageEncoder::png(job.rgb.data(), m_width, m_height, job.encoded)) {
+                return false;
+            }
+#endif
+        }
+
+        std::string filename;
+        format_filename(m_pattern, job.number, filename);
+        auto* file = fopen(filename.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        auto const is_written = job.encoded.size() == fwrite(job.encoded.data(), 1, job.encoded.size(), file);
+        return 0 == fclose(file) && is_written;
+    }
+
+    std::string const m_pattern;
+    Format const m_format;
+    size_t const m_width;
+    size_t const m_height;
+    uint32_t m_num_frames = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv_worker;
+    std::condition_variable m_cv_writer;
+    std::vector<std::unique_ptr<Job>> m_free_jobs;
+    std::deque<std::unique_ptr<Job>> m_queued_jobs;
+    bool m_is_done = false;
+    std::atomic<bool> m_is_ok;
+    std::vector<std::thread> m_threads;
+};
+
+} // namespace bv
@@ -0,0 +1,146 @@
+#include <bv/MemoryMappedFile.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace bv {
+
+#ifdef _WIN32
+
+class MemoryMappedFileImpl final : public MemoryMappedFile
+{
+public:
+    ~MemoryMappedFileImpl()
+    {
+        if (m_data) {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping) {
+            CloseHandle(m_mapping);
+        }
+        if (m_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_file);
+        }
+    }
+
+    bool open(std::string const& filename)
+    {
+        // FILE_FLAG_SEQUENTIAL_SCAN lets the cache manager read ahead aggressively
+        m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(m_file, &file_size)) {
+            return false;
+        }
+        m_size = static_cast<size_t>(file_size.QuadPart);
+        if (0 == m_size) {
+            // can't map an empty file, but it is still a valid (empty) file.
+            return true;
+        }
+
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping) {
+            return false;
+        }
+        m_data = static_cast<uint8_t const*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        return nullptr != m_data;
+    }
+
+    uint8_t const* data() const override
+    {
+        return m_data;
+    }
+
+    size_t size() const override
+    {
+        return m_size;
+    }
+
+private:
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+    uint8_t const* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+#else
+
+class MemoryMappedFileImpl final : public MemoryMappedFile
+{
+public:
+    ~MemoryMappedFileImpl()
+    {
+        if (m_data) {
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+        }
+        if (m_fd != -1) {
+            close(m_fd);
+        }
+    }
+
+    bool open(std::string const& filename)
+    {
+        m_fd = ::open(filename.c_str(), O_RDONLY);
+        if (m_fd == -1) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(m_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        m_size = static_cast<size_t>(st.st_size);
+        if (0 == m_size) {
+            // can't map an empty file, but it is still a valid (empty) file.
+            return true;
+        }
+
+        void* addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+        m_data = static_cast<uint8_t const*>(addr);
+
+        // We read the whole file exactly once from front to back: aggressive readahead, and the
+        // kernel may drop pages behind us. This is only a hint, so errors are ignored.
+        madvise(addr, m_size, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    uint8_t const* data() const override
+    {
+        return m_data;
+    }
+
+    size_t size() const override
+    {
+        return m_size;
+    }
+
+private:
+    int m_fd = -1;
+    uint8_t const* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+#endif
+
+std::unique_ptr<MemoryMappedFile> MemoryMappedFile::open(std::string const& filename)
+{
+    auto mmf = std::make_unique<MemoryMappedFileImpl>();
+    if (!mmf->open(filename)) {
+        return nullptr;
+    }
+    return mmf;
+}
+
+} // namespace bv
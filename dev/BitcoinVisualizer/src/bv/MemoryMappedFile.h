@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace bv {
+
+// Read-only memory mapping of a whole file. The OS pages the data in on demand, so reading
+// from it doesn't need any intermediate copy into a user space buffer.
+//
+// abstract class so we can hide all the nasty OS specific stuff in the .cpp file.
+class MemoryMappedFile
+{
+public:
+    virtual uint8_t const* data() const = 0;
+
+    // size in bytes
+    virtual size_t size() const = 0;
+
+    virtual ~MemoryMappedFile() = default;
+
+    // factory. Maps the file for sequential reading, returns nullptr if that is not possible.
+    static std::unique_ptr<MemoryMappedFile> open(std::string const& filename);
+};
+
+} // namespace bv
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace bv {
+
+// Same interface as BufferedStreamReader, but reads straight from a memory range (e.g. a
+// MemoryMappedFile). There is no intermediate buffer to refill, so the only check per read
+// is against the end of the data.
+class MemoryStreamReader
+{
+public:
+    MemoryStreamReader(uint8_t const* begin, uint8_t const* end)
+        : mPos(begin),
+          mEnd(end)
+    {
+    }
+
+    template <typename T>
+    void read(T& target_blob)
+    {
+        if (static_cast<size_t>(mEnd - mPos) < sizeof(T)) {
+            // not enough data left: behave like a stream that hit the end.
+            mPos = mEnd;
+            return;
+        }
+        std::memcpy(&target_blob, mPos, sizeof(T));
+        mPos += sizeof(T);
+    }
+
+    template <typename T>
+    void read1(T& target_blob)
+    {
+        if (mPos == mEnd) {
+            // reading past the end yields 0 so a varint decoder can't loop forever on broken data
+            *reinterpret_cast<uint8_t*>(&target_blob) = 0;
+            return;
+        }
+        *reinterpret_cast<uint8_t*>(&target_blob) = *mPos++;
+    }
+
+    bool eof() const
+    {
+        return mPos == mEnd;
+    }
+
+    // current read position, for decoders that want to work on the memory directly.
+    uint8_t const* pos() const
+    {
+        return mPos;
+    }
+
+    // skips num_bytes, but never beyond the end.
+    void skip(size_t num_bytes)
+    {
+        mPos += num_bytes < static_cast<size_t>(mEnd - mPos) ? num_bytes : static_cast<size_t>(mEnd - mPos);
+    }
+
+private:
+    uint8_t const* mPos;
+    uint8_t const* const mEnd;
+};
+
+} // namespace bv
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace bv {
+
+// A change that is already mapped to its pixel: the pixel's density changes by delta.
+struct PixelDelta {
+    uint32_t pixel_idx;
+    int32_t delta;
+};
+
+// Sorts by pixel and merges all entries of the same pixel into one. Entries that cancel each other
+// out are kept (with delta 0), because the pixel was still touched in this block.
+inline void aggregate(std::vector<PixelDelta>& pixel_deltas)
+{
+    if (pixel_deltas.empty()) {
+        return;
+    }
+
+    std::sort(pixel_deltas.begin(), pixel_deltas.end(), [](PixelDelta const& a, PixelDelta const& b) {
+        return a.pixel_idx < b.pixel_idx;
+    });
+
+    auto out = pixel_deltas.begin();
+    for (auto it = pixel_deltas.begin() + 1; it != pixel_deltas.end(); ++it) {
+        if (it->pixel_idx == out->pixel_idx) {
+            out->delta += it->delta;
+        } else {
+            *++out = *it;
+        }
+    }
+    pixel_deltas.erase(out + 1, pixel_deltas.end());
+}
+
+} // namespace bv
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <bv/LinearFunction.h>
+#include <bv/truncate.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace bv {
+
+// Maps a change (source block height, amount) to its pixel with a few table lookups, instead of
+// evaluating std::log and two LinearFunctions for each change. All tables are built from exactly
+// the same floating point expressions, so the mapping is bit for bit the same as evaluating them.
+//
+// x: one lookup per block height.
+//
+// y: the row only depends on the amount, and gets smaller (further up) the larger the amount is.
+// For each row we store the smallest amount that lands in it or above. An amount is bucketed by its
+// highest set bit plus the next few mantissa bits, each bucket knows the row of its largest amount,
+// so we only have to step down a row when the amount is below that row's threshold. The buckets
+// are so fine that this happens at most once or twice.
+class PixelMapper
+{
+public:
+    PixelMapper(size_t width, size_t height, LinearFunction const& fn_satoshi, LinearFunction const& fn_block, double max_blockid)
+        : m_width(width),
+          m_height(height)
+    {
+        if (width > std::numeric_limits<uint16_t>::max() || height > std::numeric_limits<uint16_t>::max()) {
+            throw std::runtime_error("PixelMapper: width and height need to be < 65536");
+        }
+
+        // x: every block height up to max_blockid. Everything after is clamped to the last column.
+        auto const num_block_heights = static_cast<size_t>(std::ceil(max_blockid < 0 ? 0 : max_blockid)) + 1;
+        m_block_height_to_x.resize(num_block_heights);
+        for (size_t block_height = 0; block_height < num_block_heights; ++block_height) {
+            auto const fx = fn_block(static_cast<double>(block_height));
+            auto const pixel_x = fx <= 0 ? 0 : truncate<size_t>(static_cast<size_t>(fx), m_width - 1);
+            m_block_height_to_x[block_height] = static_cast<uint16_t>(pixel_x);
+        }
+
+        // y: smallest amount per row, with a binary search on the exact function. Clamped before the
+        // conversion, so amounts above max_satoshi end up in the top row.
+        auto const row = [&](uint64_t famount) {
+            auto const fy = fn_satoshi(std::log(static_cast<double>(famount)));
+            return fy <= 0 ? 0 : static_cast<size_t>(truncate<double>(fy, static_cast<double>(m_height - 1)));
+        };
+        m_min_amount_for_row.resize(m_height);
+        for (size_t r = 0; r < m_height; ++r) {
+            uint64_t lo = 1;
+            uint64_t hi = max_amount;
+            if (row(hi) > r) {
+                // row is never reached
+                m_min_amount_for_row[r] = max_amount;
+                continue;
+            }
+            while (lo < hi) {
+                auto const mid = lo + (hi - lo) / 2;
+                if (row(mid) <= r) {
+                    hi = mid;
+                } else {
+                    lo = mid + 1;
+                }
+            }
+            m_min_amount_for_row[r] = lo;
+        }
+
+        // row of the largest amount of each bucket
+        auto const num_buckets = bucket(max_amount) + 1;
+        m_bucket_to_row.resize(num_buckets);
+        m_bucket_to_row[0] = static_cast<uint16_t>(m_height - 1);
+        for (size_t b = 1; b < num_buckets; ++b) {
+            m_bucket_to_row[b] = static_cast<uint16_t>(row_from_thresholds(largest_amount_in_bucket(b), 0));
+        }
+    }
+
+    uint32_t x(uint32_t block_height) const
+    {
+        if (block_height >= m_block_height_to_x.size()) {
+            return static_cast<uint32_t>(m_width - 1);
+        }
+        return m_block_height_to_x[block_height];
+    }
+
+    uint32_t y(int64_t amount) const
+    {
+        auto const famount = static_cast<uint64_t>(amount >= 0 ? amount : -amount);
+        if (0 == famount) {
+            // std::log(0) is -inf, the smallest amount possible: lowest row.
+            return static_cast<uint32_t>(m_height - 1);
+        }
+        return static_cast<uint32_t>(row_from_thresholds(famount, m_bucket_to_row[bucket(famount)]));
+    }
+
+    uint32_t pixel_idx(uint32_t block_height, int64_t amount) const
+    {
+        return static_cast<uint32_t>(y(amount) * m_width + x(block_height));
+    }
+
+private:
+    // number of mantissa bits used for bucketing, in addition to the highest set bit.
+    static int const mantissa_bits = 7;
+    static uint64_t const max_amount = static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+
+    // index of the highest set bit, famount > 0
+    static int highest_bit(uint64_t famount)
+    {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanReverse64(&idx, famount);
+        return static_cast<int>(idx);
+#else
+        return 63 - __builtin_clzll(famount);
+#endif
+    }
+
+    // Small amounts get one bucket each. Larger ones are bucketed by the highest bit and the
+    // following mantissa_bits bits. Bucket indices increase with the amount.
+    static size_t bucket(uint64_t famount)
+    {
+        auto const shift = highest_bit(famount) > mantissa_bits ? highest_bit(famount) - mantissa_bits : 0;
+        return (static_cast<size_t>(shift) << mantissa_bits) + static_cast<size_t>(famount >> shift);
+    }
+
+    static uint64_t largest_amount_in_bucket(size_t b)
+    {
+        if (b < (size_t(2) << mantissa_bits)) {
+            return b;
+        }
+        auto const shift = (b >> mantissa_bits) - 1;
+        auto const top_bits = (b & ((size_t(1) << mantissa_bits) - 1)) | (size_t(1) << mantissa_bits);
+        return (static_cast<uint64_t>(top_bits) << shift) | ((uint64_t(1) << shift) - 1);
+    }
+
+    // first row r >= start_row where famount reaches the row's threshold.
+    size_t row_from_thresholds(uint64_t famount, size_t start_row) const
+    {
+        auto r = start_row;
+        while (famount < m_min_amount_for_row[r]) {
+            ++r;
+        }
+        return r;
+    }
+
+    size_t const m_width;
+    size_t const m_height;
+    std::vector<uint16_t> m_block_height_to_x;
+    std::vector<uint64_t> m_min_amount_for_row;
+    std::vector<uint16_t> m_bucket_to_row;
+};
+
+} // namespace bv
@@ -25,18 +25,24 @@ public:
             return;
         }
         m_pixel[pixel_idx] = 1;
-        m_pixelidx.push_back(pixel_idx);
+        m_pixelidx.push_back(static_cast<uint32_t>(pixel_idx));
     }
 
-    std::vector<size_t>::const_iterator begin() const
+    std::vector<uint32_t>::const_iterator begin() const
     {
         return m_pixelidx.begin();
     }
-    std::vector<size_t>::const_iterator end() const
+    std::vector<uint32_t>::const_iterator end() const
     {
         return m_pixelidx.end();
     }
 
+    // number of set pixels
+    size_t size() const
+    {
+        return m_pixelidx.size();
+    }
+
     void clear()
     {
         for (auto pixel_idx : m_pixelidx) {
@@ -47,7 +53,7 @@ public:
 
 private:
     std::vector<uint8_t> m_pixel;
-    std::vector<size_t> m_pixelidx;
+    std::vector<uint32_t> m_pixelidx;
 };
 
 } // namespace bv
\ No newline at end of file
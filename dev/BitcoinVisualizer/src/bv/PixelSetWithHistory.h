@@ -1,90 +1,111 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <vector>
 
 namespace bv {
 
-// Basically a set for pixels. Fast if the number of changed pixels is small.
+// Basically a set for pixels, each with the frame it was last changed in. Fast if the number of
+// changed pixels is small.
 //
 // Quick O(1) to set a pixel
 // Quick O(n) to iterate all set n pixel.
 // Quick O(n) to clear all set pixels.
+//
+// Aging only touches the pixels that actually expire: each insert also puts the pixel into a
+// ring of buckets, one per frame, and age() only goes through the buckets of the frames that just
+// expired. When a pixel is set again with a later frame its old bucket entry is not removed, it
+// is just ignored when its bucket expires.
 class PixelSetWithHistory
 {
 public:
-    struct BlockheightPixelidx {
-        uint32_t block_height;
-        size_t pixel_idx;
+    // 32 bit pixel indices are enough for 8K and more, and keep m_pixel at 4 bytes per pixel.
+    struct FramePixelidx {
+        uint32_t frame;
+        uint32_t pixel_idx;
 
-        BlockheightPixelidx(uint32_t block_height, size_t pixel_idx)
-            : block_height(block_height), pixel_idx(pixel_idx)
+        FramePixelidx(uint32_t frame, uint32_t pixel_idx)
+            : frame(frame), pixel_idx(pixel_idx)
         {
         }
     };
-    using BlockheightPixelCollection = std::vector<BlockheightPixelidx>;
+    using FramePixelCollection = std::vector<FramePixelidx>;
 
     PixelSetWithHistory(size_t size, size_t max_history)
-        : m_max_history(max_history), m_pixel(size, sentinel)
+        : m_max_history(max_history),
+          m_pixel(size, static_cast<uint32_t>(sentinel)),
+          m_buckets(max_history + 2),
+          m_first_unexpired_frame(0)
     {
     }
 
     // Assumes that idx < size. O(1) operation.
-    void insert(uint32_t block_height, size_t pixel_idx)
+    void insert(uint32_t frame, size_t pixel_idx)
     {
         if (sentinel == m_pixel[pixel_idx]) {
             // not set: create entry
-            m_pixel[pixel_idx] = m_blockheight_pixelidx.size();
-            m_blockheight_pixelidx.emplace_back(block_height, pixel_idx);
+            m_pixel[pixel_idx] = static_cast<uint32_t>(m_frame_pixelidx.size());
+            m_frame_pixelidx.emplace_back(frame, static_cast<uint32_t>(pixel_idx));
         } else {
             // pixel already set: update it with the max
-            auto& pos = m_blockheight_pixelidx[m_pixel[pixel_idx]];
-            if (block_height > pos.block_height) {
-                pos.block_height = block_height;
+            auto& pos = m_frame_pixelidx[m_pixel[pixel_idx]];
+            if (frame <= pos.frame) {
+                return;
             }
+            pos.frame = frame;
         }
+
+        // a frame that has already expired goes into the bucket that expires next.
+        auto const bucket_frame = frame < m_first_unexpired_frame ? m_first_unexpired_frame : frame;
+        m_buckets[bucket_frame % m_buckets.size()].emplace_back(frame, static_cast<uint32_t>(pixel_idx));
     }
 
-    // remove all pixels older than max age
-    void age(uint32_t const current_block_height)
+    // remove all pixels that were last changed more than max_history frames ago
+    void age(uint32_t const current_frame)
     {
-        size_t idx = m_blockheight_pixelidx.size();
-        while (idx--) {
-            auto& pos_at_idx = m_blockheight_pixelidx[idx];
-            if (pos_at_idx.block_height + m_max_history < current_block_height) {
-                // clear that pixel
-                m_pixel[pos_at_idx.pixel_idx] = sentinel;
-
-                // move last entry to the now vacant position (if we are not at the end)
-                if (idx != m_blockheight_pixelidx.size() - 1) {
-                    pos_at_idx = std::move(m_blockheight_pixelidx.back());
-                    m_pixel[pos_at_idx.pixel_idx] = idx;
-                }
-
-                // get rid of moved entry
-                m_blockheight_pixelidx.pop_back();
-            }
+        if (current_frame <= m_max_history) {
+            return;
+        }
+        auto const end_frame = static_cast<uint32_t>(current_frame - m_max_history);
+
+        // each bucket only needs to be done once, even after a jump of many frames.
+        auto frame = m_first_unexpired_frame;
+        if (end_frame - frame > m_buckets.size()) {
+            frame = end_frame - static_cast<uint32_t>(m_buckets.size());
+        }
+        for (; frame < end_frame; ++frame) {
+            expire(m_buckets[frame % m_buckets.size()], frame);
+        }
+        if (end_frame > m_first_unexpired_frame) {
+            m_first_unexpired_frame = end_frame;
         }
     }
 
-    BlockheightPixelCollection::const_iterator begin() const
+    FramePixelCollection::const_iterator begin() const
     {
-        return m_blockheight_pixelidx.begin();
+        return m_frame_pixelidx.begin();
     }
-    BlockheightPixelCollection::const_iterator end() const
+    FramePixelCollection::const_iterator end() const
     {
-        return m_blockheight_pixelidx.end();
+        return m_frame_pixelidx.end();
     }
 
     size_t size() const
     {
-        return m_blockheight_pixelidx.size();
+        return m_frame_pixelidx.size();
     }
 
     void clear()
     {
-        std::fill(m_pixel.begin(), m_pixel.end(), sentinel);
-        m_blockheight_pixelidx.clear();
+        std::fill(m_pixel.begin(), m_pixel.end(), static_cast<uint32_t>(sentinel));
+        m_frame_pixelidx.clear();
+        for (auto& bucket : m_buckets) {
+            bucket.clear();
+        }
+        m_first_unexpired_frame = 0;
     }
 
     size_t max_history() const
@@ -93,11 +114,43 @@ public:
     }
 
 private:
-    static const size_t sentinel = std::numeric_limits<size_t>::max();
+    // Removes the pixels of the bucket that expire at expired_frame. After a jump over many frames
+    // the bucket can also hold later frames, these stay.
+    void expire(FramePixelCollection& bucket, uint32_t expired_frame)
+    {
+        size_t num_kept = 0;
+        for (auto const& entry : bucket) {
+            if (entry.frame > expired_frame) {
+                bucket[num_kept++] = entry;
+                continue;
+            }
+
+            // only if the pixel wasn't set again since then
+            auto const idx = m_pixel[entry.pixel_idx];
+            if (sentinel == idx || m_frame_pixelidx[idx].frame != entry.frame) {
+                continue;
+            }
+
+            // clear that pixel, and move the last entry to the now vacant position
+            m_pixel[entry.pixel_idx] = sentinel;
+            if (idx != m_frame_pixelidx.size() - 1) {
+                m_frame_pixelidx[idx] = m_frame_pixelidx.back();
+                m_pixel[m_frame_pixelidx[idx].pixel_idx] = idx;
+            }
+            m_frame_pixelidx.pop_back();
+        }
+        bucket.erase(bucket.begin() + static_cast<std::ptrdiff_t>(num_kept), bucket.end());
+    }
+
+    static const uint32_t sentinel = std::numeric_limits<uint32_t>::max();
     size_t const m_max_history;
 
-    std::vector<size_t> m_pixel;
-    BlockheightPixelCollection m_blockheight_pixelidx;
+    std::vector<uint32_t> m_pixel;
+    FramePixelCollection m_frame_pixelidx;
+
+    // ring of buckets by frame, and the first frame whose pixels are still in the set.
+    std::vector<FramePixelCollection> m_buckets;
+    uint32_t m_first_unexpired_frame;
 };
 
 } // namespace bv
\ No newline at end of file
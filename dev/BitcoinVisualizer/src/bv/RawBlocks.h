@@ -0,0 +1,406 @@
+#pragma once
+
+#include <bv/Change.h>
+#include <bv/MemoryMappedFile.h>
+#include <bv/MemoryStreamReader.h>
+#include <bv/Sha256.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace bv {
+
+// Replays the raw block files of a Bitcoin Core node (the blk*.dat files in its blocks
+// directory), and produces the same changes the Ruby UtxoFetcher writes into .blk files, without
+// any RPC: for each transaction, every spent output is removed (negative amount, with the height
+// of the block that created it), then every new output is added.
+//
+// Bitcoin Core stores the blocks in the order they were downloaded, which is not the chain order,
+// and also keeps blocks that didn't make it into the chain. So all files are indexed first, and
+// the longest chain from the genesis block is replayed. The spent outputs are looked up in an
+// in-memory UTXO set keyed by outpoint, which needs a lot of memory for the whole chain.
+// Files obfuscated with xor.dat (Bitcoin Core 28 and later) are supported.
+class RawBlocks
+{
+public:
+    // Replays the chain up to to_block_height, and calls begin_block(), change() and end_block()
+    // for the blocks from from_block_height on, like Blk::decode: the changes of each block come
+    // in the same order as from a .blk file. The blocks before from_block_height are needed for
+    // the UTXO set, so they are replayed too. Returns false if no blocks are found, or a spent
+    // output is not in the UTXO set. Sets last_block_height like Blk does.
+    template <class T>
+    static bool replay(std::string const& blocks_dir, uint32_t from_block_height, uint32_t to_block_height, T& callback, uint32_t* last_block_height)
+    {
+        if (last_block_height) {
+            *last_block_height = 0;
+        }
+        RawBlocks raw_blocks(blocks_dir);
+        if (!raw_blocks.build_chain()) {
+            return false;
+        }
+
+        std::vector<uint8_t> block;
+        std::vector<Change> changes;
+        auto const num_blocks = raw_blocks.m_chain.size();
+        for (uint32_t block_height = 0; block_height < num_blocks && block_height <= to_block_height; ++block_height) {
+            auto const& entry = raw_blocks.m_entries[raw_blocks.m_chain[block_height]];
+            changes.clear();
+            if (!raw_blocks.read(entry.file_idx, entry.offset, entry.num_bytes, block)
+                || !raw_blocks.integrate_block(block, block_height, changes)) {
+                return false;
+            }
+            if (block_height < from_block_height) {
+                continue;
+            }
+
+            std::sort(changes.begin(), changes.end(), is_before_in_record);
+            callback.begin_block(block_height);
+            for (size_t i = 0; i < changes.size(); ++i) {
+                auto const is_same_as_previous_change = i != 0 && changes[i].amount == changes[i - 1].amount
+                    && changes[i].block_height == changes[i - 1].block_height;
+                callback.change(changes[i].block_height, changes[i].amount, is_same_as_previous_change);
+            }
+            callback.end_block(block_height);
+            if (last_block_height) {
+                *last_block_height = block_height;
+            }
+        }
+        return true;
+    }
+
+private:
+    using Hash = Sha256::Digest;
+
+    struct HashHasher {
+        size_t operator()(Hash const& hash) const
+        {
+            // the hash is already as random as it gets
+            size_t h;
+            std::memcpy(&h, hash.data(), sizeof(h));
+            return h;
+        }
+    };
+
+    // Location of a block in the blk*.dat files.
+    struct Entry {
+        Hash hash;
+        Hash previous_hash;
+        uint32_t file_idx;
+        size_t offset;
+        uint32_t num_bytes;
+    };
+
+    // An output of a transaction. Only the first 16 bytes of the txid are used, like the Ruby
+    // UtxoFetcher does, which is still plenty to prevent any collision.
+    struct OutPoint {
+        uint64_t txid_begin;
+        uint64_t txid_end;
+        uint32_t vout;
+
+        bool operator==(OutPoint const& other) const
+        {
+            return txid_begin == other.txid_begin && txid_end == other.txid_end && vout == other.vout;
+        }
+    };
+
+    struct OutPointHasher {
+        size_t operator()(OutPoint const& op) const
+        {
+            return static_cast<size_t>(op.txid_begin ^ (op.vout * UINT64_C(0x9E3779B97F4A7C15)));
+        }
+    };
+
+    // the unspent output: its amount, and where it was created
+    struct Unspent {
+        int64_t amount;
+        uint32_t block_height;
+    };
+
+    static size_t const header_size = 80;
+    static size_t const max_cached_files = 4;
+
+    explicit RawBlocks(std::string const& blocks_dir)
+        : m_blocks_dir(blocks_dir),
+          m_xor_key{},
+          m_is_obfuscated(false)
+    {
+        std::ifstream fin(blocks_dir + "/xor.dat", std::ios::binary);
+        if (fin.read(reinterpret_cast<char*>(m_xor_key.data()), m_xor_key.size())) {
+            m_is_obfuscated = std::any_of(m_xor_key.begin(), m_xor_key.end(), [](uint8_t b) { return b != 0; });
+        }
+    }
+
+    // Indexes all blk*.dat files, and finds the longest chain that starts at the genesis block.
+    bool build_chain()
+    {
+        uint32_t network_magic = 0;
+        for (uint32_t file_idx = 0; file(file_idx) != nullptr; ++file_idx) {
+            auto const file_size = file(file_idx)->size();
+            size_t offset = 0;
+            std::vector<uint8_t> buf;
+            while (offset + 8 + header_size <= file_size && read(file_idx, offset, 8 + header_size, buf)) {
+                // network magic, block size, block. The rest of the file is preallocated with zeros.
+                uint32_t magic;
+                uint32_t num_bytes;
+                std::memcpy(&magic, buf.data(), sizeof(magic));
+                std::memcpy(&num_bytes, buf.data() + 4, sizeof(num_bytes));
+                // a block is at least the header and the number of transactions.
+                if (magic == 0 || (network_magic != 0 && magic != network_magic) || num_bytes <= header_size || offset + 8 + num_bytes > file_size) {
+                    break;
+                }
+                network_magic = magic;
+
+                Entry entry;
+                entry.hash = Sha256::double_hash(buf.data() + 8, header_size);
+                std::memcpy(entry.previous_hash.data(), buf.data() + 8 + 4, entry.previous_hash.size());
+                entry.file_idx = file_idx;
+                entry.offset = offset + 8;
+                entry.num_bytes = num_bytes;
+                m_entries.push_back(entry);
+                offset += 8 + num_bytes;
+            }
+        }
+
+        std::unordered_map<Hash, size_t, HashHasher> entry_idx_of;
+        for (size_t i = 0; i < m_entries.size(); ++i) {
+            entry_idx_of.emplace(m_entries[i].hash, i);
+        }
+
+        // height of each block, -1 if not known yet, and -2 if it isn't connected to the genesis block.
+        std::vector<int64_t> heights(m_entries.size(), -1);
+        std::vector<size_t> todo;
+        for (size_t i = 0; i < m_entries.size(); ++i) {
+            // walks back until a block with a known height is found, then sets the heights on the way back.
+            auto entry_idx = i;
+            while (heights[entry_idx] == -1) {
+                todo.push_back(entry_idx);
+                auto const& previous_hash = m_entries[entry_idx].previous_hash;
+                if (std::all_of(previous_hash.begin(), previous_hash.end(), [](uint8_t b) { return b == 0; })) {
+                    heights[entry_idx] = 0;
+                    todo.pop_back();
+                    break;
+                }
+                auto const it = entry_idx_of.find(previous_hash);
+                if (it == entry_idx_of.end()) {
+                    heights[entry_idx] = -2;
+                    todo.pop_back();
+                    break;
+                }
+                entry_idx = it->second;
+            }
+            while (!todo.empty()) {
+                heights[todo.back()] = heights[entry_idx] < 0 ? -2 : heights[entry_idx] + 1;
+                entry_idx = todo.back();
+                todo.pop_back();
+            }
+        }
+
+        auto const tip = std::max_element(heights.begin(), heights.end());
+        if (tip == heights.end() || *tip < 0) {
+            return false;
+        }
+        m_chain.resize(static_cast<size_t>(*tip) + 1);
+        auto entry_idx = static_cast<size_t>(tip - heights.begin());
+        for (auto h = m_chain.size(); h != 0; --h) {
+            m_chain[h - 1] = entry_idx;
+            if (h > 1) {
+                entry_idx = entry_idx_of[m_entries[entry_idx].previous_hash];
+            }
+        }
+        return true;
+    }
+
+    // Updates the UTXO set with all transactions of the block, and appends the changes.
+    bool integrate_block(std::vector<uint8_t> const& block, uint32_t block_height, std::vector<Change>& changes)
+    {
+        if (block.size() <= header_size) {
+            return false;
+        }
+        auto const* end = block.data() + block.size();
+        MemoryStreamReader msr(block.data() + header_size, end);
+        auto const num_transactions = compact_size(msr);
+        if (num_transactions == 0) {
+            return false;
+        }
+        for (uint64_t tx_idx = 0; tx_idx < num_transactions; ++tx_idx) {
+            if (!integrate_transaction(msr, end, block_height, tx_idx == 0, changes)) {
+                return false;
+            }
+        }
+        return msr.eof();
+    }
+
+    // Transaction format: int32_t version, [0x00 0x01 if it has witness data], inputs, outputs,
+    // [witness data], uint32_t lock time. The txid is the hash of everything except the witness
+    // data and its marker. end is the end of the block: a transaction always ends with the lock
+    // time, so running into it earlier means the data is broken.
+    bool integrate_transaction(MemoryStreamReader& msr, uint8_t const* end, uint32_t block_height, bool is_coinbase, std::vector<Change>& changes)
+    {
+        Sha256 sha;
+        auto const* begin = msr.pos();
+        msr.skip(4);
+        auto const has_witness = end - msr.pos() >= 2 && msr.pos()[0] == 0 && msr.pos()[1] == 1;
+        if (has_witness) {
+            sha.update(begin, 4);
+            msr.skip(2);
+            begin = msr.pos();
+        }
+
+        auto const num_inputs = compact_size(msr);
+        for (uint64_t i = 0; i < num_inputs; ++i) {
+            if (msr.eof()) {
+                return false;
+            }
+            Hash txid{};
+            uint32_t vout = 0;
+            msr.read(txid);
+            msr.read(vout);
+            msr.skip(static_cast<size_t>(compact_size(msr)));
+            msr.skip(4);
+
+            // the coinbase doesn't spend anything
+            if (is_coinbase) {
+                continue;
+            }
+            auto const it = m_utxo.find(out_point(txid, vout));
+            if (it == m_utxo.end()) {
+                return false;
+            }
+            changes.push_back({it->second.block_height, -it->second.amount});
+            m_utxo.erase(it);
+        }
+
+        auto const num_outputs = compact_size(msr);
+        m_outputs.clear();
+        for (uint64_t i = 0; i < num_outputs; ++i) {
+            if (msr.eof()) {
+                return false;
+            }
+            int64_t amount = 0;
+            msr.read(amount);
+            msr.skip(static_cast<size_t>(compact_size(msr)));
+            m_outputs.push_back(amount);
+            changes.push_back({block_height, amount});
+        }
+        sha.update(begin, static_cast<size_t>(msr.pos() - begin));
+
+        if (has_witness) {
+            for (uint64_t i = 0; i < num_inputs; ++i) {
+                auto const num_items = compact_size(msr);
+                for (uint64_t item = 0; item < num_items; ++item) {
+                    if (msr.eof()) {
+                        return false;
+                    }
+                    msr.skip(static_cast<size_t>(compact_size(msr)));
+                }
+            }
+        }
+        if (end - msr.pos() < 4) {
+            return false;
+        }
+        sha.update(msr.pos(), 4);
+        msr.skip(4);
+
+        // A txid can appear twice (BIP 30, e.g. the coinbases of blocks 91812 and 91842), then
+        // the newer outputs replace the old ones, just like in the Ruby UtxoFetcher.
+        auto const txid = Sha256::double_hash(sha);
+        for (size_t vout = 0; vout < m_outputs.size(); ++vout) {
+            m_utxo[out_point(txid, static_cast<uint32_t>(vout))] = {m_outputs[vout], block_height};
+        }
+        return true;
+    }
+
+    static OutPoint out_point(Hash const& txid, uint32_t vout)
+    {
+        OutPoint op;
+        std::memcpy(&op.txid_begin, txid.data(), sizeof(op.txid_begin));
+        std::memcpy(&op.txid_end, txid.data() + sizeof(op.txid_begin), sizeof(op.txid_end));
+        op.vout = vout;
+        return op;
+    }
+
+    // bitcoin's variable length integer: < 0xfd is the value itself, 0xfd, 0xfe and 0xff are
+    // followed by an uint16_t, uint32_t or uint64_t.
+    static uint64_t compact_size(MemoryStreamReader& msr)
+    {
+        uint8_t first = 0;
+        msr.read1(first);
+        if (first < 0xfd) {
+            return first;
+        }
+        if (first == 0xfd) {
+            uint16_t val = 0;
+            msr.read(val);
+            return val;
+        }
+        if (first == 0xfe) {
+            uint32_t val = 0;
+            msr.read(val);
+            return val;
+        }
+        uint64_t val = 0;
+        msr.read(val);
+        return val;
+    }
+
+    // Copies num_bytes from the file at offset into buf, and removes the obfuscation.
+    bool read(uint32_t file_idx, size_t offset, size_t num_bytes, std::vector<uint8_t>& buf)
+    {
+        auto const* mmf = file(file_idx);
+        if (mmf == nullptr || offset + num_bytes > mmf->size()) {
+            return false;
+        }
+        buf.assign(mmf->data() + offset, mmf->data() + offset + num_bytes);
+        if (m_is_obfuscated) {
+            for (size_t i = 0; i < num_bytes; ++i) {
+                buf[i] ^= m_xor_key[(offset + i) % m_xor_key.size()];
+            }
+        }
+        return true;
+    }
+
+    // The blocks are mostly in order, so only the last few files stay mapped. Returns nullptr if
+    // the file doesn't exist.
+    MemoryMappedFile const* file(uint32_t file_idx)
+    {
+        for (auto const& cached : m_files) {
+            if (cached.first == file_idx) {
+                return cached.second.get();
+            }
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "/blk%05u.dat", file_idx);
+        auto mmf = MemoryMappedFile::open(m_blocks_dir + name);
+        if (!mmf) {
+            return nullptr;
+        }
+        if (m_files.size() == max_cached_files) {
+            m_files.erase(m_files.begin());
+        }
+        m_files.emplace_back(file_idx, std::move(mmf));
+        return m_files.back().second.get();
+    }
+
+    std::string const m_blocks_dir;
+    std::array<uint8_t, 8> m_xor_key;
+    bool m_is_obfuscated;
+    std::vector<std::pair<uint32_t, std::unique_ptr<MemoryMappedFile>>> m_files;
+
+    // all blocks found in the files, and the ones of the chain by height.
+    std::vector<Entry> m_entries;
+    std::vector<size_t> m_chain;
+
+    std::unordered_map<OutPoint, Unspent, OutPointHasher> m_utxo;
+    std::vector<int64_t> m_outputs;
+};
+
+} // namespace bv
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace bv {
+
+// Plain SHA-256 (FIPS 180-4), for the block and transaction hashes of RawBlocks. Data can be
+// added in pieces with update(), e.g. to hash a transaction without its witness data.
+class Sha256
+{
+public:
+    using Digest = std::array<uint8_t, 32>;
+
+    Sha256()
+        : m_state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19},
+          m_num_bytes(0)
+    {
+    }
+
+    void update(uint8_t const* data, size_t size)
+    {
+        auto buffered = static_cast<size_t>(m_num_bytes % 64);
+        m_num_bytes += size;
+        if (buffered != 0) {
+            auto const n = size < 64 - buffered ? size : 64 - buffered;
+            std::memcpy(m_buffer + buffered, data, n);
+            data += n;
+            size -= n;
+            buffered += n;
+            if (buffered < 64) {
+                return;
+            }
+            transform(m_buffer);
+        }
+        while (size >= 64) {
+            transform(data);
+            data += 64;
+            size -= 64;
+        }
+        std::memcpy(m_buffer, data, size);
+    }
+
+    Digest finish()
+    {
+        uint8_t padding[72] = {0x80};
+        auto const num_bits = m_num_bytes * 8;
+        auto const buffered = static_cast<size_t>(m_num_bytes % 64);
+        auto const num_padding = (buffered < 56 ? 56 : 120) - buffered;
+        for (size_t i = 0; i < 8; ++i) {
+            padding[num_padding + i] = static_cast<uint8_t>(num_bits >> (56 - 8 * i));
+        }
+        update(padding, num_padding + 8);
+
+        Digest digest;
+        for (size_t i = 0; i < 8; ++i) {
+            digest[4 * i] = static_cast<uint8_t>(m_state[i] >> 24);
+            digest[4 * i + 1] = static_cast<uint8_t>(m_state[i] >> 16);
+            digest[4 * i + 2] = static_cast<uint8_t>(m_state[i] >> 8);
+            digest[4 * i + 3] = static_cast<uint8_t>(m_state[i]);
+        }
+        return digest;
+    }
+
+    // SHA-256 of the SHA-256, as bitcoin uses it for block hashes and txids.
+    static Digest double_hash(Sha256& first)
+    {
+        auto const digest = first.finish();
+        Sha256 second;
+        second.update(digest.data(), digest.size());
+        return second.finish();
+    }
+
+    static Digest double_hash(uint8_t const* data, size_t size)
+    {
+        Sha256 first;
+        first.update(data, size);
+        return double_hash(first);
+    }
+
+private:
+    static uint32_t rotr(uint32_t x, int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    void transform(uint8_t const* chunk)
+    {
+        static uint32_t const k[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                                       0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                                       0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                                       0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                                       0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                                       0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                                       0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                                       0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        uint32_t w[64];
+        for (size_t i = 0; i < 16; ++i) {
+            w[i] = static_cast<uint32_t>(chunk[4 * i]) << 24 | static_cast<uint32_t>(chunk[4 * i + 1]) << 16
+                | static_cast<uint32_t>(chunk[4 * i + 2]) << 8 | static_cast<uint32_t>(chunk[4 * i + 3]);
+        }
+        for (size_t i = 16; i < 64; ++i) {
+            auto const s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            auto const s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto a = m_state[0];
+        auto b = m_state[1];
+        auto c = m_state[2];
+        auto d = m_state[3];
+        auto e = m_state[4];
+        auto f = m_state[5];
+        auto g = m_state[6];
+        auto h = m_state[7];
+        for (size_t i = 0; i < 64; ++i) {
+            auto const s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            auto const ch = (e & f) ^ (~e & g);
+            auto const t1 = h + s1 + ch + k[i] + w[i];
+            auto const s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            auto const maj = (a & b) ^ (a & c) ^ (b & c);
+            auto const t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+        m_state[4] += e;
+        m_state[5] += f;
+        m_state[6] += g;
+        m_state[7] += h;
+    }
+
+    uint32_t m_state[8];
+    uint64_t m_num_bytes;
+    uint8_t m_buffer[64];
+};
+
+} // namespace bv
@@ -1,44 +1,389 @@
 #include <bv/SocketStream.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
 #include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <csignal>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
 namespace bv {
 
+namespace {
+
+// Frames are large (25MB for 4K), a large send buffer means fewer round trips through the kernel.
+int const send_buffer_size = 8 * 1024 * 1024;
+
+} // namespace
+
+#ifdef _WIN32
+
 class SocketStreamImpl final : public SocketStream
 {
 public:
-    SocketStreamImpl(char const* ip_addr, uint16_t socket_nr)
+    ~SocketStreamImpl()
+    {
+        if (m_socket != INVALID_SOCKET) {
+            closesocket(m_socket);
+        }
+        if (m_is_wsa_started) {
+            WSACleanup();
+        }
+    }
+
+    bool connect(char const* host, uint16_t port)
+    {
+        WSADATA wsadata;
+        if (0 != WSAStartup(MAKEWORD(2, 2), &wsadata)) {
+            return false;
+        }
+        m_is_wsa_started = true;
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (0 != getaddrinfo(host, std::to_string(port).c_str(), &hints, &addresses)) {
+            return false;
+        }
+        for (auto* ai = addresses; ai != nullptr && m_socket == INVALID_SOCKET; ai = ai->ai_next) {
+            m_socket = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (m_socket != INVALID_SOCKET && 0 != ::connect(m_socket, ai->ai_addr, static_cast<int>(ai->ai_addrlen))) {
+                closesocket(m_socket);
+                m_socket = INVALID_SOCKET;
+            }
+        }
+        freeaddrinfo(addresses);
+        if (m_socket == INVALID_SOCKET) {
+            return false;
+        }
+
+        // don't wait for more data when a frame is finished, and send big chunks
+        BOOL const no_delay = TRUE;
+        setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char const*>(&no_delay), sizeof(no_delay));
+        setsockopt(m_socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<char const*>(&send_buffer_size), sizeof(send_buffer_size));
+        return true;
+    }
+
+    bool write(uint8_t const* data, size_t size) override
+    {
+        // send may only take part of the data
+        while (size != 0) {
+            auto const chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+            auto const num_sent = send(m_socket, reinterpret_cast<char const*>(data), chunk, 0);
+            if (num_sent == SOCKET_ERROR) {
+                return false;
+            }
+            data += num_sent;
+            size -= static_cast<size_t>(num_sent);
+        }
+        return true;
+    }
+
+private:
+    bool m_is_wsa_started = false;
+    SOCKET m_socket = INVALID_SOCKET;
+};
+
+// standard output, pipes and files
+class FileStreamImpl final : public SocketStream
+{
+public:
+    FileStreamImpl(FILE* file, bool is_pipe)
+        : m_file(file),
+          m_is_pipe(is_pipe)
+    {
+    }
+
+    ~FileStreamImpl()
     {
-        WSAStartup(MAKEWORD(2, 0), &m_wsadata);
-        m_socket = socket(AF_INET, SOCK_STREAM, 0);
+        if (m_is_pipe) {
+            _pclose(m_file);
+        } else if (m_file != stdout) {
+            fclose(m_file);
+        } else {
+            fflush(m_file);
+        }
+    }
+
+    bool write(uint8_t const* data, size_t size) override
+    {
+        return size == fwrite(data, 1, size, m_file);
+    }
+
+private:
+    FILE* const m_file;
+    bool const m_is_pipe;
+};
+
+std::unique_ptr<SocketStream> SocketStream::create(const char* ip_addr, uint16_t socket)
+{
+    auto stream = std::make_unique<SocketStreamImpl>();
+    if (!stream->connect(ip_addr, socket)) {
+        return nullptr;
+    }
+    return std::move(stream);
+}
+
+namespace {
+
+std::unique_ptr<SocketStream> create_unix(std::string const&)
+{
+    // not supported
+    return nullptr;
+}
+
+std::unique_ptr<SocketStream> create_stdout()
+{
+    // no \n -> \r\n conversion
+    _setmode(_fileno(stdout), _O_BINARY);
+    return std::make_unique<FileStreamImpl>(stdout, false);
+}
+
+std::unique_ptr<SocketStream> create_pipe(std::string const& command)
+{
+    auto* pipe = _popen(command.c_str(), "wb");
+    if (pipe == nullptr) {
+        return nullptr;
+    }
+    return std::make_unique<FileStreamImpl>(pipe, true);
+}
+
+std::unique_ptr<SocketStream> create_file(std::string const& filename)
+{
+    auto* file = fopen(filename.c_str(), "wb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+    return std::make_unique<FileStreamImpl>(file, false);
+}
+
+} // namespace
 
-        m_addr.sin_addr.s_addr = inet_addr(ip_addr);
-        m_addr.sin_family = AF_INET;
-        m_addr.sin_port = htons(socket_nr);
+#else
 
-        connect(m_socket, (SOCKADDR*)&m_addr, sizeof(m_addr));
+// Everything that is a file descriptor: TCP and unix domain sockets, standard output, pipes, files.
+class SocketStreamImpl final : public SocketStream
+{
+public:
+    // the stream owns fd, and closes it (or pipe) when done.
+    SocketStreamImpl(int fd, FILE* pipe)
+        : m_fd(fd),
+          m_pipe(pipe)
+    {
     }
 
     ~SocketStreamImpl()
     {
-        closesocket(m_socket);
-        WSACleanup();
+        if (m_pipe != nullptr) {
+            // waits until the command has finished
+            pclose(m_pipe);
+        } else if (m_fd != STDOUT_FILENO) {
+            close(m_fd);
+        }
+    }
+
+    bool write(uint8_t const* data, size_t size) override
+    {
+        // write may only take part of the data
+        while (size != 0) {
+            auto const num_written = ::write(m_fd, data, size);
+            if (num_written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += num_written;
+            size -= static_cast<size_t>(num_written);
+        }
+        return true;
     }
 
-    void write(uint8_t const* data, size_t size) override
+    bool writev(Buffer const* buffers, size_t count) override
     {
-        send(m_socket, reinterpret_cast<char const*>(data), static_cast<int>(size), 0);
+        m_iov.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            m_iov[i].iov_base = const_cast<uint8_t*>(buffers[i].data);
+            m_iov[i].iov_len = buffers[i].size;
+        }
+
+        size_t idx = 0;
+        while (idx != count) {
+            auto const num_iov = static_cast<int>(std::min<size_t>(count - idx, IOV_MAX));
+            auto num_written = ::writev(m_fd, m_iov.data() + idx, num_iov);
+            if (num_written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+
+            // skip everything that was written, and continue where it stopped
+            while (idx != count && static_cast<size_t>(num_written) >= m_iov[idx].iov_len) {
+                num_written -= static_cast<ssize_t>(m_iov[idx].iov_len);
+                ++idx;
+            }
+            if (idx != count) {
+                m_iov[idx].iov_base = static_cast<uint8_t*>(m_iov[idx].iov_base) + num_written;
+                m_iov[idx].iov_len -= static_cast<size_t>(num_written);
+            }
+        }
+        return true;
     }
 
 private:
-    WSADATA m_wsadata;
-    SOCKET m_socket;
-    SOCKADDR_IN m_addr;
+    int const m_fd;
+    FILE* const m_pipe;
+    std::vector<iovec> m_iov;
 };
 
+namespace {
+
+// When the receiver goes away (e.g. ffmpeg is closed) we want write to fail, instead of being killed by SIGPIPE.
+void ignore_sigpipe()
+{
+    std::signal(SIGPIPE, SIG_IGN);
+}
+
+void set_send_buffer_size(int fd)
+{
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer_size, sizeof(send_buffer_size));
+}
+
+std::unique_ptr<SocketStream> create_unix(std::string const& path)
+{
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return nullptr;
+    }
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, path.size());
+
+    auto const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    if (0 != connect(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr))) {
+        close(fd);
+        return nullptr;
+    }
+    set_send_buffer_size(fd);
+    ignore_sigpipe();
+    return std::make_unique<SocketStreamImpl>(fd, nullptr);
+}
+
+std::unique_ptr<SocketStream> create_stdout()
+{
+    ignore_sigpipe();
+    return std::make_unique<SocketStreamImpl>(STDOUT_FILENO, nullptr);
+}
+
+std::unique_ptr<SocketStream> create_pipe(std::string const& command)
+{
+    auto* pipe = popen(command.c_str(), "w");
+    if (pipe == nullptr) {
+        return nullptr;
+    }
+    ignore_sigpipe();
+    return std::make_unique<SocketStreamImpl>(fileno(pipe), pipe);
+}
+
+std::unique_ptr<SocketStream> create_file(std::string const& filename)
+{
+    auto const fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    return std::make_unique<SocketStreamImpl>(fd, nullptr);
+}
+
+} // namespace
+
 std::unique_ptr<SocketStream> SocketStream::create(const char* ip_addr, uint16_t socket)
 {
-    return std::make_unique<SocketStreamImpl>(ip_addr, socket);
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (0 != getaddrinfo(ip_addr, std::to_string(socket).c_str(), &hints, &addresses)) {
+        return nullptr;
+    }
+    int fd = -1;
+    for (auto* ai = addresses; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && 0 != connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    // don't wait for more data when a frame is finished, and send big chunks
+    int const no_delay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    set_send_buffer_size(fd);
+    ignore_sigpipe();
+    return std::make_unique<SocketStreamImpl>(fd, nullptr);
+}
+
+#endif
+
+std::unique_ptr<SocketStream> SocketStream::create(std::string const& spec)
+{
+    auto const starts_with = [&](char const* prefix) {
+        return 0 == spec.compare(0, std::char_traits<char>::length(prefix), prefix);
+    };
+
+    if (is_stdout(spec)) {
+        return create_stdout();
+    }
+    if (starts_with("pipe:")) {
+        return create_pipe(spec.substr(5));
+    }
+    if (starts_with("unix:")) {
+        return create_unix(spec.substr(5));
+    }
+    if (starts_with("file:")) {
+        return create_file(spec.substr(5));
+    }
+
+    // "tcp:HOST:PORT" or "HOST:PORT"
+    auto const host_port = starts_with("tcp:") ? spec.substr(4) : spec;
+    auto const pos = host_port.rfind(':');
+    if (pos == std::string::npos || pos == 0 || pos + 1 == host_port.size()) {
+        return nullptr;
+    }
+    auto const port = std::strtoul(host_port.c_str() + pos + 1, nullptr, 10);
+    if (port == 0 || port > 65535) {
+        return nullptr;
+    }
+    return create(host_port.substr(0, pos).c_str(), static_cast<uint16_t>(port));
 }
 
 } // namespace bv
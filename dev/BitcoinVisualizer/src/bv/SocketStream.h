@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
 
 namespace bv {
 
@@ -9,12 +10,45 @@ namespace bv {
 class SocketStream
 {
 public:
-    virtual void write(uint8_t const* data, size_t size) = 0;
+    struct Buffer {
+        uint8_t const* data;
+        size_t size;
+    };
+
+    // Writes all the data, also when the OS only accepts part of it at once. Returns false if the
+    // receiver is gone.
+    virtual bool write(uint8_t const* data, size_t size) = 0;
+
+    // Writes several buffers in one go (e.g. a header and the frame), without copying them together.
+    virtual bool writev(Buffer const* buffers, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            if (!write(buffers[i].data, buffers[i].size)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     virtual ~SocketStream() = default;
 
-    // factory
+    // factory for a TCP connection. Returns nullptr if it can't connect.
     static std::unique_ptr<SocketStream> create(const char* ip_addr, uint16_t socket);
+
+    // Factory for all kinds of sinks, returns nullptr if it can't be opened:
+    //   "HOST:PORT" or "tcp:HOST:PORT"  TCP connection, e.g. to ffmpeg -i tcp://127.0.0.1:12987?listen
+    //   "unix:PATH"                     unix domain socket (not on Windows)
+    //   "-" or "stdout"                 standard output, e.g. to pipe into ffmpeg -i -
+    //   "pipe:COMMAND"                  starts COMMAND and writes into its standard input
+    //   "file:PATH"                     writes everything into a file
+    static std::unique_ptr<SocketStream> create(std::string const& spec);
+
+    // true if the spec writes to standard output, so nothing else must be printed there.
+    static bool is_stdout(std::string const& spec)
+    {
+        return spec == "-" || spec == "stdout";
+    }
 };
 
 
-} // namespace bv
\ No newline at end of file
+} // namespace bv
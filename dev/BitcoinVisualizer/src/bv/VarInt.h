@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace bv {
+
+// LEB128 style variable length integer encoding, same as VarInt in the Ruby UtxoFetcher. Signed
+// values are zigzag encoded so small negative numbers stay small.
+class VarInt
+{
+public:
+    template <typename T>
+    static void encode_uint(std::vector<uint8_t>& out, T val)
+    {
+        static_assert(std::is_unsigned<T>::value, "only for unsigned types");
+
+        while (val >= 0b10000000) {
+            out.push_back(static_cast<uint8_t>(val | 0b10000000));
+            val >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(val));
+    }
+
+    static void encode_int32(std::vector<uint8_t>& out, int32_t val)
+    {
+        encode_uint(out, (static_cast<uint32_t>(val) << 1) ^ static_cast<uint32_t>(val >> 31));
+    }
+
+    // Reads one varint from a stream that provides read1(), e.g. BufferedStreamReader.
+    // Returns the number of bytes read.
+    template <typename S, typename T>
+    static size_t decode_uint(S& is, T& val)
+    {
+        static_assert(std::is_unsigned<T>::value, "only for unsigned types");
+
+        int num_bytes = 0;
+        val = 0;
+        uint8_t byte;
+        is.read1(byte);
+        while (byte & 0b10000000) {
+            val |= static_cast<T>(byte & 0b01111111) << (7 * num_bytes);
+            ++num_bytes;
+            is.read1(byte);
+        }
+        val |= static_cast<T>(byte) << (7 * num_bytes);
+        return num_bytes + 1;
+    }
+
+    template <typename S>
+    static size_t decode_int32(S& is, int32_t& val)
+    {
+        uint32_t v;
+        auto num_bytes = decode_uint(is, v);
+        val = static_cast<int32_t>((v >> 1) ^ (uint32_t)0 - (v & 1));
+        return num_bytes;
+    }
+};
+
+} // namespace bv
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <bv/FrameWriter.h>
+#include <bv/SocketStream.h>
+#include <bv/Yuv444.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bv {
+
+// Writes the frames as a YUV 4:4:4 Y4M stream, for ffmpeg -f yuv4mpegpipe. The encoder then gets
+// the planar YUV it wants directly, instead of converting every pixel of every RGB frame itself.
+//
+// The YUV planes are kept from frame to frame, and only the pixels that changed since the
+// previous frame are converted again. That is usually a tiny part of the frame.
+class Y4mFrameWriter final : public FrameWriter
+{
+public:
+    Y4mFrameWriter(std::unique_ptr<SocketStream> stream, size_t width, size_t height, uint32_t frame_rate)
+        : m_stream(std::move(stream)),
+          m_width(width),
+          m_height(height),
+          m_yuv(3 * width * height),
+          m_is_header_written(false)
+    {
+        // progressive, square pixels, limited range (see Yuv444)
+        m_header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F" + std::to_string(frame_rate)
+            + ":1 Ip A1:1 C444 XCOLORRANGE=LIMITED\n";
+    }
+
+    bool write(Frame const& frame) override
+    {
+        auto const plane_size = m_width * m_height;
+        uint8_t* const planes[3] = {m_yuv.data(), m_yuv.data() + plane_size, m_yuv.data() + 2 * plane_size};
+        size_t const linesizes[3] = {m_width, m_width, m_width};
+        Yuv444::update(frame, m_width, m_height, planes, linesizes);
+
+        static char const frame_header[] = "FRAME\n";
+        SocketStream::Buffer buffers[] = {{reinterpret_cast<uint8_t const*>(m_header.data()), m_header.size()},
+                                          {reinterpret_cast<uint8_t const*>(frame_header), sizeof(frame_header) - 1},
+                                          {m_yuv.data(), m_yuv.size()}};
+        auto const is_ok = m_is_header_written ? m_stream->writev(buffers + 1, 2) : m_stream->writev(buffers, 3);
+        m_is_header_written = true;
+        return is_ok;
+    }
+
+private:
+    std::unique_ptr<SocketStream> const m_stream;
+    size_t const m_width;
+    size_t const m_height;
+
+    // Y plane, then U (Cb) plane, then V (Cr) plane
+    std::vector<uint8_t> m_yuv;
+    std::string m_header;
+    bool m_is_header_written;
+};
+
+} // namespace bv
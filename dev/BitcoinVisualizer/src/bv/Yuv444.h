@@ -0,0 +1,51 @@
+#pragma once
+
+#include <bv/FrameWriter.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bv {
+
+// Converts RGB frames into planar YUV 4:4:4, with the integer BT.601 limited range formulas (see
+// https://en.wikipedia.org/wiki/YCbCr). That is also what ffmpeg does by default for rgb24 to
+// yuv444p.
+class Yuv444
+{
+public:
+    // Updates the Y, U (Cb) and V (Cr) planes from the frame. The planes need to hold the previous
+    // frame, then only the pixels that changed since then are converted. linesize is the number
+    // of bytes from one row of a plane to the next.
+    static void update(Frame const& frame, size_t width, size_t height, uint8_t* const planes[3], size_t const linesizes[3])
+    {
+        auto const* rgb = frame.rgb.data();
+        if (frame.is_all_changed) {
+            for (size_t y = 0; y < height; ++y) {
+                for (size_t x = 0; x < width; ++x) {
+                    convert(rgb + 3 * (y * width + x), planes, linesizes, x, y);
+                }
+            }
+        } else {
+            for (auto const pixel_idx : frame.changed_pixels) {
+                auto const y = pixel_idx / width;
+                auto const x = pixel_idx - y * width;
+                convert(rgb + 3 * static_cast<size_t>(pixel_idx), planes, linesizes, x, y);
+            }
+        }
+    }
+
+private:
+    static void convert(uint8_t const* rgb, uint8_t* const planes[3], size_t const linesizes[3], size_t x, size_t y)
+    {
+        int const r = rgb[0];
+        int const g = rgb[1];
+        int const b = rgb[2];
+
+        // the offsets are added before shifting, so only positive values are shifted.
+        planes[0][y * linesizes[0] + x] = static_cast<uint8_t>((66 * r + 129 * g + 25 * b + 128 + (16 << 8)) >> 8);
+        planes[1][y * linesizes[1] + x] = static_cast<uint8_t>((-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8);
+        planes[2][y * linesizes[2] + x] = static_cast<uint8_t>((112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8);
+    }
+};
+
+} // namespace bv
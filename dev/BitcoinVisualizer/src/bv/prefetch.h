@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BV_PREFETCH
+#include <xmmintrin.h>
+#endif
+
+namespace bv {
+
+// How many pixels ahead the loops over scattered pixels prefetch, enough to overlap the misses.
+size_t const prefetch_distance = 16;
+
+// Starts loading the cache line of p, for data that is accessed a few iterations later.
+inline void prefetch(void const* p)
+{
+#if defined(BV_PREFETCH)
+    _mm_prefetch(static_cast<char const*>(p), _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+} // namespace bv
@@ -1,12 +1,27 @@
+#include <bv/AvCodecFrameWriter.h>
 #include <bv/Blk.h>
+#include <bv/BlkWriter.h>
 #include <bv/ColorMap.h>
+#include <bv/Config.h>
+#include <bv/DeltaFrame.h>
 #include <bv/Density.h>
+#include <bv/FramePacer.h>
+#include <bv/FrameWriter.h>
+#include <bv/ImageSequenceWriter.h>
+#include <bv/RawBlocks.h>
+#include <bv/Y4mFrameWriter.h>
 
 #include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
 #include <unordered_set>
+#include <vector>
 
 //#include <intrin.h>
 
@@ -36,6 +51,114 @@ struct CheckSequential {
     uint64_t m_num_changes = 0;
 };
 
+// forwards all events to the density, and writes a checkpoint of its state every few blocks.
+struct CheckpointingDensity {
+    void begin_block(uint32_t block_height)
+    {
+        m_density.begin_block(block_height);
+    }
+
+    void change(uint32_t block_height, int64_t amount, bool is_same_as_previous_change)
+    {
+        m_density.change(block_height, amount, is_same_as_previous_change);
+    }
+
+    uint32_t pixel_idx(uint32_t block_height, int64_t amount) const
+    {
+        return m_density.pixel_idx(block_height, amount);
+    }
+
+    void apply(bv::PixelDelta const* pixel_deltas, size_t count)
+    {
+        m_density.apply(pixel_deltas, count);
+    }
+
+    void end_block(uint32_t block_height)
+    {
+        m_density.end_block(block_height);
+        // none at block 0: resuming from there would save nothing, so --resume never looks for it.
+        if (m_checkpoint_every != 0 && block_height != 0 && block_height % m_checkpoint_every == 0) {
+            auto const filename = checkpoint_filename(m_checkpoint_dir, block_height);
+            if (!m_density.save_checkpoint(filename)) {
+                std::cout << "could not write checkpoint " << filename << std::endl;
+            }
+        }
+    }
+
+    static std::string checkpoint_filename(std::string const& dir, uint32_t block_height)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "checkpoint_%08u.bvc", block_height);
+        return dir + "/" + buf;
+    }
+
+    bv::Density& m_density;
+    uint32_t const m_checkpoint_every;
+    std::string const m_checkpoint_dir;
+};
+
+// hashes all events of a decoded .blk file, so two change streams can be compared.
+struct ChangeStreamHash {
+    void begin_block(uint32_t block_height)
+    {
+        add(block_height);
+    }
+
+    void change(uint32_t block_height, int64_t amount, bool is_same_as_previous_change)
+    {
+        add(block_height);
+        add(static_cast<uint64_t>(amount));
+        add(is_same_as_previous_change);
+        ++m_num_changes;
+    }
+
+    void end_block(uint32_t block_height)
+    {
+        add(block_height);
+        ++m_num_blocks;
+    }
+
+    // FNV-1a, one value at a time
+    void add(uint64_t value)
+    {
+        m_hash = (m_hash ^ value) * 1099511628211ull;
+    }
+
+    uint64_t m_hash = 14695981039346656037ull;
+    uint64_t m_num_blocks = 0;
+    uint64_t m_num_changes = 0;
+};
+
+// writes all decoded blocks again with the BlkWriter, and hashes them on the way.
+struct RewriteBlk {
+    explicit RewriteBlk(bv::BlkWriter& writer)
+        : m_writer(writer)
+    {
+    }
+
+    void begin_block(uint32_t block_height)
+    {
+        m_hash.begin_block(block_height);
+        m_writer.begin_block(block_height);
+    }
+
+    void change(uint32_t block_height, int64_t amount, bool is_same_as_previous_change)
+    {
+        m_hash.change(block_height, amount, is_same_as_previous_change);
+        m_writer.add(block_height, amount);
+    }
+
+    void end_block(uint32_t block_height)
+    {
+        m_hash.end_block(block_height);
+        m_is_ok = m_writer.end_block() && m_is_ok;
+    }
+
+    bv::BlkWriter& m_writer;
+    ChangeStreamHash m_hash;
+    bool m_is_ok = true;
+};
+
 
 template <class T>
 double dur(T before)
@@ -43,58 +166,374 @@ double dur(T before)
     return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - before).count();
 }
 
+// Microbenchmark: decodes all records of a .blk file once byte by byte with VarInt (like
+// decode_stream does for buffered files) and once with BulkVarInt, and compares the results.
+bool benchmark_varint_decoding(std::string const& filename)
+{
+    auto mapped_file = bv::MemoryMappedFile::open(filename);
+    bv::BlkIndex index;
+    if (!mapped_file || !index.build(mapped_file->data(), mapped_file->data() + mapped_file->size())) {
+        std::cout << "could not read " << filename << std::endl;
+        return false;
+    }
+
+    // skip the header and the first change of each record, which are not varint encoded
+    size_t const skip_bytes = bv::BlkIndex::header_size + sizeof(int64_t) + sizeof(uint32_t);
+
+    int const num_rounds = 5;
+    uint64_t num_changes = 0;
+    uint64_t checksum_scalar = 0;
+    auto t = std::chrono::high_resolution_clock::now();
+    for (int round = 0; round < num_rounds; ++round) {
+        for (auto const& e : index) {
+            auto const* record = mapped_file->data() + e.offset;
+            bv::MemoryStreamReader msr(record + skip_bytes, record + e.num_bytes);
+            while (!msr.eof()) {
+                uint64_t amount_diff;
+                int32_t block_height_diff;
+                bv::VarInt::decode_uint(msr, amount_diff);
+                bv::VarInt::decode_int32(msr, block_height_diff);
+                checksum_scalar = checksum_scalar * 31 + amount_diff + static_cast<uint32_t>(block_height_diff);
+                ++num_changes;
+            }
+        }
+    }
+    auto const duration_scalar = dur(t);
+
+    std::vector<uint64_t> amount_diffs;
+    std::vector<int32_t> block_height_diffs;
+    uint64_t checksum_bulk = 0;
+    t = std::chrono::high_resolution_clock::now();
+    for (int round = 0; round < num_rounds; ++round) {
+        for (auto const& e : index) {
+            auto const* record = mapped_file->data() + e.offset;
+            // decode_pairs only decodes complete pairs, each takes at least 2 bytes.
+            size_t const num_varint_bytes = e.num_bytes - skip_bytes;
+            if (amount_diffs.size() < num_varint_bytes / 2) {
+                amount_diffs.resize(num_varint_bytes / 2);
+                block_height_diffs.resize(num_varint_bytes / 2);
+            }
+            auto const n = bv::BulkVarInt::decode_pairs(record + skip_bytes, record + e.num_bytes, amount_diffs.data(), block_height_diffs.data());
+            for (size_t i = 0; i < n; ++i) {
+                checksum_bulk = checksum_bulk * 31 + amount_diffs[i] + static_cast<uint32_t>(block_height_diffs[i]);
+            }
+        }
+    }
+    auto const duration_bulk = dur(t);
+
+    std::cout << (num_changes / num_rounds) << " varint encoded changes" << std::endl;
+    std::cout << "VarInt:     " << (num_changes / (duration_scalar * 1000'000)) << "M changes per second" << std::endl;
+    std::cout << "BulkVarInt: " << (num_changes / (duration_bulk * 1000'000)) << "M changes per second" << std::endl;
+    std::cout << "results identical? " << (checksum_scalar == checksum_bulk ? "YES" : "NO") << std::endl;
+    return checksum_scalar == checksum_bulk;
+}
+
+// Round trip check of the BlkWriter: decodes the input file, writes all its blocks again into
+// selftest_filename, decodes that one too, and compares both change streams.
+bool selftest_blk_writer(std::string const& filename, std::string const& selftest_filename)
+{
+    ChangeStreamHash written;
+    bool is_write_ok;
+    {
+        bv::BlkWriter writer(selftest_filename);
+        if (!writer.is_open()) {
+            std::cout << "could not write " << selftest_filename << std::endl;
+            return false;
+        }
+        RewriteBlk rewrite(writer);
+        if (!bv::Blk::decode(filename, rewrite, nullptr)) {
+            std::remove(selftest_filename.c_str());
+            std::cout << "could not read " << filename << std::endl;
+            return false;
+        }
+        written = rewrite.m_hash;
+        is_write_ok = rewrite.m_is_ok && writer.flush();
+    }
+
+    ChangeStreamHash read_back;
+    auto const is_read_ok = is_write_ok && bv::Blk::decode(selftest_filename, read_back, nullptr);
+    std::remove(selftest_filename.c_str());
+
+    auto const is_identical = is_read_ok && written.m_hash == read_back.m_hash && written.m_num_blocks == read_back.m_num_blocks &&
+                              written.m_num_changes == read_back.m_num_changes;
+    std::cout << written.m_num_blocks << " blocks with " << written.m_num_changes << " changes written, "
+              << read_back.m_num_blocks << " blocks with " << read_back.m_num_changes << " changes read back" << std::endl;
+    std::cout << "round trip identical? " << (is_identical ? "YES" : "NO") << std::endl;
+    return is_identical;
+}
+
+// parses "<first><separator><second>", e.g. "7680x4320" or "0:550000"
+template <class T>
+bool parse_pair(std::string const& str, char separator, T& first, T& second)
+{
+    auto const pos = str.find(separator);
+    if (pos == std::string::npos || pos == 0 || pos + 1 == str.size()) {
+        return false;
+    }
+    first = static_cast<T>(std::stoull(str.substr(0, pos)));
+    second = static_cast<T>(std::stoull(str.substr(pos + 1)));
+    return true;
+}
+
 int main(int argc, char** argv)
 {
-    if (argc != 2) {
-        std::cout << "usage: bv input.bin" << std::endl;
+    // positional arguments: input file, optionally followed by a block range
+    std::vector<std::string> positional;
+    uint32_t checkpoint_every = 0;
+    std::string checkpoint_dir = ".";
+    bool resume = false;
+    bv::Config config;
+    bool is_config_ok = true;
+    bool bench_varint = false;
+    bool selftest = false;
+    bool is_raw_blocks = false;
+    size_t num_threads = std::thread::hardware_concurrency();
+    size_t num_encoder_threads = std::thread::hardware_concurrency();
+    bv::AvCodecFrameWriter::Options codec_options;
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        if (arg == "--checkpoint-every" && i + 1 < argc) {
+            checkpoint_every = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--checkpoint-dir" && i + 1 < argc) {
+            checkpoint_dir = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            num_threads = std::stoul(argv[++i]);
+        } else if (arg == "--encoder-threads" && i + 1 < argc) {
+            num_encoder_threads = std::stoul(argv[++i]);
+        } else if (arg == "--codec" && i + 1 < argc) {
+            codec_options.codec = argv[++i];
+        } else if (arg == "--crf" && i + 1 < argc) {
+            codec_options.crf = std::stoi(argv[++i]);
+        } else if (arg == "--raw-blocks") {
+            is_raw_blocks = true;
+        } else if (arg == "--bench-varint") {
+            bench_varint = true;
+        } else if (arg == "--selftest") {
+            selftest = true;
+        } else if (arg == "--resume") {
+            resume = true;
+        } else if (arg == "--tiled-grid") {
+            config.grid_layout = bv::DensityGrid<>::Layout::tiled;
+        } else if (arg == "--resolution" && i + 1 < argc) {
+            is_config_ok &= parse_pair(argv[++i], 'x', config.width, config.height);
+        } else if (arg == "--satoshi" && i + 1 < argc) {
+            is_config_ok &= parse_pair(argv[++i], ':', config.min_satoshi, config.max_satoshi);
+        } else if (arg == "--blocks" && i + 1 < argc) {
+            is_config_ok &= parse_pair(argv[++i], ':', config.min_block_height, config.max_block_height);
+        } else if (arg == "--start" && i + 1 < argc) {
+            config.start_block_height = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--stop" && i + 1 < argc) {
+            config.stop_block_height = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--max-density" && i + 1 < argc) {
+            config.image_max_density = std::stoul(argv[++i]);
+        } else if (arg == "--stream-max-density" && i + 1 < argc) {
+            config.stream_max_density = std::stoul(argv[++i]);
+        } else if (arg == "--blocks-per-frame" && i + 1 < argc) {
+            config.blocks_per_frame = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--frames" && i + 1 < argc) {
+            config.num_frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--seconds-per-frame" && i + 1 < argc) {
+            config.seconds_per_frame = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--block-times" && i + 1 < argc) {
+            config.block_times_file = argv[++i];
+        } else if (arg == "--history" && i + 1 < argc) {
+            config.max_history = std::stoul(argv[++i]);
+        } else if (arg == "--highlight-radius" && i + 1 < argc) {
+            config.highlight_radius = std::stoul(argv[++i]);
+        } else if (arg == "--sink" && i + 1 < argc) {
+            config.sink = argv[++i];
+        } else if (arg == "--frame-buffers" && i + 1 < argc) {
+            config.frame_buffers = std::stoul(argv[++i]);
+        } else if (arg == "--delta-frames") {
+            config.delta_frames = true;
+        } else if (arg == "--keyframe-interval" && i + 1 < argc) {
+            config.keyframe_interval = std::stoul(argv[++i]);
+        } else if (arg == "--y4m") {
+            config.y4m = true;
+        } else if (arg == "--fps" && i + 1 < argc) {
+            config.frame_rate = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    auto const config_error = config.validate();
+    if (!config_error.empty()) {
+        std::cout << "invalid configuration: " << config_error << std::endl;
+        is_config_ok = false;
+    }
+    if ((positional.size() != 1 && positional.size() != 3) || (resume && checkpoint_every == 0) || !is_config_ok) {
+        std::cout << "usage: bv input.bin [from_block_height to_block_height] [options]" << std::endl;
+        std::cout << "  --resolution WxH      output resolution (default: 3840x2160, e.g. 7680x4320 for 8K)" << std::endl;
+        std::cout << "  --satoshi MIN:MAX     amount range, bottom to top row (default: 1:1000000000000)" << std::endl;
+        std::cout << "  --blocks MIN:MAX      block height range, first to last column (default: 0:550000)" << std::endl;
+        std::cout << "  --start B             only emit frames from block B on, blocks before are only integrated" << std::endl;
+        std::cout << "  --stop B              stop after block B" << std::endl;
+        std::cout << "  --max-density N       density with the brightest color in final.ppm (default: 444)" << std::endl;
+        std::cout << "  --stream-max-density N" << std::endl;
+        std::cout << "                        density with the brightest color in the streamed frames (default: 2000)" << std::endl;
+        std::cout << "  --blocks-per-frame N  integrate N blocks into each frame (default: 1)" << std::endl;
+        std::cout << "  --frames N            choose blocks per frame so that the rendered range takes about N frames" << std::endl;
+        std::cout << "  --seconds-per-frame S each frame covers S seconds of chain time instead of a number of blocks" << std::endl;
+        std::cout << "  --block-times FILE    median time of each block for --seconds-per-frame (default: headers.tsv)" << std::endl;
+        std::cout << "  --history N           number of frames changed pixels stay highlighted (default: 50)" << std::endl;
+        std::cout << "  --highlight-radius N  changed pixels also highlight neighbours up to N pixels away, 1 to 3 (default: 1)" << std::endl;
+        std::cout << "  --sink SINK           where the frames are streamed to (default: 127.0.0.1:12987):" << std::endl;
+        std::cout << "                        HOST:PORT, unix:PATH, - for stdout, pipe:COMMAND or file:PATH," << std::endl;
+        std::cout << "                        images:PATTERN for one QOI or PNG file per frame, e.g. images:img/%08d.qoi," << std::endl;
+        std::cout << "                        or encode:FILE to encode a video with libavcodec, e.g. encode:utxo.mkv" << std::endl;
+        std::cout << "  --frame-buffers N     number of frames queued for the sink while integration goes on (default: 3)" << std::endl;
+        std::cout << "  --delta-frames        only send the changed pixels of each frame, bv_receiver turns them into raw frames" << std::endl;
+        std::cout << "  --keyframe-interval N send a full frame every N frames with --delta-frames, 0 for never (default: 600)" << std::endl;
+        std::cout << "  --y4m                 send YUV 4:4:4 frames as Y4M, for ffmpeg -f yuv4mpegpipe without color conversion" << std::endl;
+        std::cout << "  --fps N               frame rate of the Y4M stream or encoded video (default: 60)" << std::endl;
+        std::cout << "  --checkpoint-every K  write the full state into DIR every K blocks" << std::endl;
+        std::cout << "  --resume              continue from the nearest checkpoint at or before from_block_height" << std::endl;
+        std::cout << "                        (or from the latest one if no range is given)" << std::endl;
+        std::cout << "  --threads N           number of decoding threads, 1 decodes on the main thread (default: all cores)" << std::endl;
+        std::cout << "  --encoder-threads N   number of threads encoding images or video (default: all cores)" << std::endl;
+        std::cout << "  --codec NAME          libavcodec encoder for encode:FILE, e.g. libx264, libx265 or ffv1 (default: libx264)" << std::endl;
+        std::cout << "  --crf N               constant rate factor for encode:FILE, -1 for the encoder's default (default: 0, lossless)" << std::endl;
+        std::cout << "  --tiled-grid          store the density counters in 4x4 tiles instead of row by row" << std::endl;
+        std::cout << "  --raw-blocks          the input is the blocks directory of a Bitcoin Core node (blk*.dat) instead of a .blk file" << std::endl;
+        std::cout << "  --bench-varint        only benchmark varint decoding of the input file" << std::endl;
+        std::cout << "  --selftest            only check that the input file reads back the same after writing it with BlkWriter" << std::endl;
         return 1;
     }
 
 
-    std::string filename = argv[1];
+    std::string filename = positional[0];
+    if (bench_varint) {
+        return benchmark_varint_decoding(filename) ? 0 : 1;
+    }
+    if (selftest) {
+        // written into the working directory like final.ppm, the input's directory might be read-only.
+        return selftest_blk_writer(filename, "bv_selftest.blk") ? 0 : 1;
+    }
     auto t = std::chrono::high_resolution_clock::now();
 
 
-    size_t const density_per_pixel = static_cast<size_t>(1000) * 3840 * 2160;
-    size_t const width = 3840;
-    size_t const height = 2160;
-    size_t const max_included_density = 444;
-
-    //size_t const width = 2560;
-    //size_t const height = 1440;
-    // size_t const max_included_density = 1000;
-    
-
-    uint32_t const stream_every_x_block = std::numeric_limits<uint32_t>::max();
-    //uint32_t const stream_every_x_block = 100;
-    bv::Density density(
-        width,                   // width
-        height,                  // height
-        1,                       // minimum satoshi
-        10'000ULL * 100'000'000, // max satoshi,
-        0,                       // minimum block height
-        550'000                  // maximum block height
-    );
-    uint32_t last_block_height;
-    bool isOk = bv::Blk::decode(filename, density, &last_block_height);
-    std::cout << last_block_height << " last block height" << std::endl;
+    auto frame_pacer = bv::FramePacer::create(config);
+    if (!frame_pacer) {
+        std::cout << "could not read block times from " << config.block_times_file << std::endl;
+        return 1;
+    }
 
-	// show last frame a few times
-    auto block_height = last_block_height;
-    for (size_t i = 0; i < 600; ++i) {
-        ++block_height;
-        density.begin_block(block_height);
-        density.end_block(block_height);
+    std::unique_ptr<bv::FrameWriter> frame_writer;
+    std::string const images_prefix = "images:";
+    std::string const encode_prefix = "encode:";
+    if (0 == config.sink.compare(0, images_prefix.size(), images_prefix)) {
+        auto const pattern = config.sink.substr(images_prefix.size());
+        frame_writer = bv::ImageSequenceWriter::create(pattern, config.width, config.height, num_encoder_threads);
+        if (!frame_writer) {
+            std::cout << "could not write images to " << pattern << ", it needs exactly one %d and the extension .qoi";
+#ifdef BV_WITH_ZLIB
+            std::cout << " or .png";
+#else
+            std::cout << " (.png needs a build with BV_WITH_ZLIB)";
+#endif
+            std::cout << std::endl;
+            return 1;
+        }
+    } else if (0 == config.sink.compare(0, encode_prefix.size(), encode_prefix)) {
+        auto const video_filename = config.sink.substr(encode_prefix.size());
+        codec_options.num_threads = static_cast<int>(num_encoder_threads);
+        codec_options.frame_rate = config.frame_rate;
+        frame_writer = bv::AvCodecFrameWriter::open(video_filename, config.width, config.height, codec_options);
+        if (!frame_writer) {
+#ifdef BV_WITH_LIBAVCODEC
+            std::cout << "could not encode " << video_filename << " with " << codec_options.codec << std::endl;
+#else
+            std::cout << "encode: needs a build with BV_WITH_LIBAVCODEC" << std::endl;
+#endif
+            return 1;
+        }
+    } else {
+        auto sink = bv::SocketStream::create(config.sink);
+        if (!sink) {
+            std::cout << "could not open sink " << config.sink << std::endl;
+            return 1;
+        }
+        if (bv::SocketStream::is_stdout(config.sink)) {
+            // the frames go to stdout, so everything else has to go to stderr
+            std::cout.rdbuf(std::cerr.rdbuf());
+        }
+        if (config.delta_frames) {
+            frame_writer = std::make_unique<bv::DeltaFrameWriter>(std::move(sink), config.width, config.height, config.keyframe_interval);
+        } else if (config.y4m) {
+            frame_writer = std::make_unique<bv::Y4mFrameWriter>(std::move(sink), config.width, config.height, config.frame_rate);
+        } else {
+            frame_writer = std::make_unique<bv::RawFrameWriter>(std::move(sink));
+        }
+    }
+    bv::Density density(config, std::move(frame_pacer), std::move(frame_writer));
+    uint32_t from_block_height = 0;
+    uint32_t to_block_height = std::numeric_limits<uint32_t>::max();
+    if (positional.size() == 3) {
+        from_block_height = static_cast<uint32_t>(std::stoul(positional[1]));
+        to_block_height = static_cast<uint32_t>(std::stoul(positional[2]));
+    }
+    if (config.stop_block_height < to_block_height) {
+        to_block_height = config.stop_block_height;
     }
 
-    bv::DensityToImage toi(width, height, max_included_density, // max included density value for colorization
-        bv::ColorMap::viridis());                               // colorization type
+    if (resume) {
+        // checkpoints are written every checkpoint_every blocks, so we just have to probe the candidates.
+        auto const exists = [&](uint32_t h) {
+            return std::ifstream(CheckpointingDensity::checkpoint_filename(checkpoint_dir, h)).is_open();
+        };
+        uint32_t checkpoint_height = 0;
+        if (positional.size() == 3) {
+            checkpoint_height = from_block_height / checkpoint_every * checkpoint_every;
+            while (checkpoint_height != 0 && !exists(checkpoint_height)) {
+                checkpoint_height -= checkpoint_every;
+            }
+        } else {
+            while (exists(checkpoint_height + checkpoint_every)) {
+                checkpoint_height += checkpoint_every;
+            }
+        }
+
+        if (checkpoint_height != 0 && density.load_checkpoint(CheckpointingDensity::checkpoint_filename(checkpoint_dir, checkpoint_height))) {
+            std::cout << "resuming from checkpoint at block " << density.current_block_height() << std::endl;
+            from_block_height = density.current_block_height() + 1;
+        } else {
+            std::cout << "no checkpoint found, starting from the beginning" << std::endl;
+            from_block_height = 0;
+        }
+    }
+
+    CheckpointingDensity checkpointing_density{density, checkpoint_every, checkpoint_dir};
+    uint32_t last_block_height = 0;
+    bool isOk;
+    if (is_raw_blocks) {
+        // the UTXO set is always built from the genesis block, the changes only go out from from_block_height on
+        isOk = bv::RawBlocks::replay(filename, from_block_height, to_block_height, checkpointing_density, &last_block_height);
+    } else if (num_threads > 1) {
+        // workers decode ahead, the main thread only integrates
+        isOk = bv::Blk::decode_parallel(filename, from_block_height, to_block_height, checkpointing_density, num_threads - 1, &last_block_height);
+    } else if (from_block_height != 0 || to_block_height != std::numeric_limits<uint32_t>::max()) {
+        // only decode the given range, using the index file to skip all blocks before it
+        isOk = bv::Blk::decode_range(filename, from_block_height, to_block_height, checkpointing_density, &last_block_height);
+    } else {
+        isOk = bv::Blk::decode(filename, checkpointing_density, &last_block_height);
+    }
+    std::cout << last_block_height << " last block height" << std::endl;
+
+    // show last frame a few times
+    density.append_still_frames(600);
+
+    bv::DensityToImage toi(config.width, config.height, config.image_max_density, // max included density value for colorization
+        bv::ColorMap::viridis());                                                  // colorization type
 
     density.save_image_ppm(toi, "final.ppm");
+    auto const is_sink_ok = density.flush();
 
     auto duration = dur(t);
     std::cout << "done in " << duration << " seconds." << std::endl;
     std::cout << "Parsing ok? " << (isOk ? "YES" : "NO") << std::endl;
+    if (!is_sink_ok) {
+        std::cout << "could not write all frames to " << config.sink << std::endl;
+    }
 
 
     /*
@@ -0,0 +1,59 @@
+// Receives the delta frames of bv --delta-frames, and writes them as raw RGB frames to stdout, e.g.
+//
+//   nc -l 12987 | bv_receiver | ffmpeg -f rawvideo -pix_fmt rgb24 -s 3840x2160 -r 60 -i - out.mp4
+//
+// Reads from stdin, or from the file given as argument.
+
+#include <bv/DeltaFrame.h>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+int main(int argc, char** argv)
+{
+    if (argc > 2) {
+        std::cerr << "usage: bv_receiver [input]" << std::endl;
+        return 1;
+    }
+
+#ifdef _WIN32
+    // no \n -> \r\n conversion
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    FILE* in = stdin;
+    if (argc == 2 && std::string(argv[1]) != "-") {
+        in = fopen(argv[1], "rb");
+        if (in == nullptr) {
+            std::cerr << "could not open " << argv[1] << std::endl;
+            return 1;
+        }
+    }
+
+    bv::DeltaFrameReader reader(in);
+    size_t num_frames = 0;
+    bv::DeltaFrameReader::Result result;
+    while (bv::DeltaFrameReader::Result::ok == (result = reader.read())) {
+        auto const& rgb = reader.rgb();
+        if (rgb.size() != fwrite(rgb.data(), 1, rgb.size(), stdout)) {
+            std::cerr << "could not write frame " << num_frames << std::endl;
+            return 1;
+        }
+        ++num_frames;
+    }
+    fflush(stdout);
+
+    std::cerr << num_frames << " frames of " << reader.width() << "x" << reader.height() << std::endl;
+    if (result == bv::DeltaFrameReader::Result::error) {
+        std::cerr << "broken input after frame " << num_frames << std::endl;
+        return 1;
+    }
+    return 0;
+}
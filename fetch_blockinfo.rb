@@ -35,3 +35,13 @@ File.open(filename, "wb") do |f|
     Marshal.dump(headers, f)
 end
 puts "dumping done!"
+
+# height and median time of each block, for BitcoinVisualizer --seconds-per-frame
+puts "writing headers.tsv..."
+File.open("headers.tsv", "wb") do |f|
+    headers.each do |blockinfo|
+        next if blockinfo.nil?
+        f.write "#{blockinfo["height"]}\t#{blockinfo["mediantime"]}\n"
+    end
+end
+puts "writing done!"
@@ -17,7 +17,12 @@ def each_amount(satosi_min, satoshi_max, &proc)
 	end
 end
 
-density = Density.new(3840, 2160, 0.00000001, 100000, 0, 550000)
+# usage: ruby generate_legend.rb [width height max_block_height]
+width_pixel = (ARGV[0] || 3840).to_i
+height_pixel = (ARGV[1] || 2160).to_i
+max_block_height = (ARGV[2] || 550000).to_i
+
+density = Density.new(width_pixel, height_pixel, 0.00000001, btc_max, 0, max_block_height)
 
 width = 10
 height = density.height